@@ -0,0 +1,165 @@
+#include "chess.h"
+
+// precomputed attack tables.
+// leapers get a plain square -> attacks lookup, sliders get magic bitboards
+// (or PEXT when the target has BMI2) so a slider's attacks are one table load.
+
+u64 knight_attacks[64] = {};
+u64 king_attacks[64] = {};
+u64 pawn_attacks[2][64] = {};
+
+u64 squares_between[64][64] = {};
+
+Magic rook_magics[64] = {};
+Magic bishop_magics[64] = {};
+
+// sum over every square of 2^(relevant occupancy bits)
+static u64 rook_table[102400];
+static u64 bishop_table[5248];
+
+static const int rook_dirs[4][2]   = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+static const int bishop_dirs[4][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
+
+static bool on_board(int row, int col) {
+    return row >= 0 && row < 8 && col >= 0 && col < 8;
+}
+
+// walk each ray one square at a time, stopping on (and including) the first blocker
+static u64 slow_slider_attacks(int square, u64 occ, const int dirs[4][2]) {
+    u64 attacks = 0;
+    for_range(d, 0, 4) {
+        int row = square / 8 + dirs[d][0];
+        int col = square % 8 + dirs[d][1];
+        while (on_board(row, col)) {
+            attacks |= bit(row * 8 + col);
+            if (occ & bit(row * 8 + col)) break;
+            row += dirs[d][0];
+            col += dirs[d][1];
+        }
+    }
+    return attacks;
+}
+
+// same rays, but without the last square of each ray.
+// the edge square is attacked no matter what is on it, so it doesnt affect the index.
+static u64 relevant_mask(int square, const int dirs[4][2]) {
+    u64 mask = 0;
+    for_range(d, 0, 4) {
+        int row = square / 8 + dirs[d][0];
+        int col = square % 8 + dirs[d][1];
+        while (on_board(row + dirs[d][0], col + dirs[d][1])) {
+            mask |= bit(row * 8 + col);
+            row += dirs[d][0];
+            col += dirs[d][1];
+        }
+    }
+    return mask;
+}
+
+static u64 leaper_attacks(int square, const int offsets[][2], int num_offsets) {
+    u64 attacks = 0;
+    for_range(i, 0, num_offsets) {
+        int row = square / 8 + offsets[i][0];
+        int col = square % 8 + offsets[i][1];
+        if (on_board(row, col)) attacks |= bit(row * 8 + col);
+    }
+    return attacks;
+}
+
+#ifndef __BMI2__
+// separate generator from mrand so the zobrist keys dont depend on init order
+static u64 magic_rand_state = 0x9E3779B97F4A7C15ull;
+
+static u64 magic_rand() {
+    magic_rand_state ^= magic_rand_state >> 12;
+    magic_rand_state ^= magic_rand_state << 25;
+    magic_rand_state ^= magic_rand_state >> 27;
+    return magic_rand_state * 0x2545F4914F6CDD1Dull;
+}
+#endif
+
+static void init_slider(Magic* magics, u64* table, const int dirs[4][2]) {
+    u64 occupancies[4096];
+    u64 attacks[4096];
+#ifndef __BMI2__
+    u32 epoch[4096] = {};
+    u32 attempt = 0;
+#endif
+
+    u64* cursor = table;
+    for_range(square, 0, 64) {
+        Magic* m = &magics[square];
+        m->mask = relevant_mask(square, dirs);
+        m->shift = 64 - popcount(m->mask);
+        m->attacks = cursor;
+
+        // enumerate every subset of the mask (carry-rippler)
+        int size = 0;
+        u64 occ = 0;
+        do {
+            occupancies[size] = occ;
+            attacks[size] = slow_slider_attacks(square, occ, dirs);
+            size++;
+            occ = (occ - m->mask) & m->mask;
+        } while (occ != 0);
+        cursor += size;
+
+#ifdef __BMI2__
+        for_range(i, 0, size) {
+            m->attacks[_pext_u64(occupancies[i], m->mask)] = attacks[i];
+        }
+#else
+        // find a magic that maps every subset to a slot without destructive collisions
+        for (intptr_t i = 0; i < size;) {
+            do {
+                m->magic = magic_rand() & magic_rand() & magic_rand();
+            } while (popcount((m->mask * m->magic) >> 56) < 6);
+
+            attempt++;
+            for (i = 0; i < size; i++) {
+                u64 index = ((occupancies[i] & m->mask) * m->magic) >> m->shift;
+                if (epoch[index] < attempt) {
+                    epoch[index] = attempt;
+                    m->attacks[index] = attacks[i];
+                } else if (m->attacks[index] != attacks[i]) {
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
+
+void init_attacks() {
+    static const int knight_offsets[8][2] = {
+        {-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1},
+    };
+    static const int king_offsets[8][2] = {
+        {-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1},
+    };
+    // white pawns move up the board (towards index 0), black pawns move down
+    static const int white_pawn_offsets[2][2] = {{-1, -1}, {-1, 1}};
+    static const int black_pawn_offsets[2][2] = {{1, -1}, {1, 1}};
+
+    for_range(square, 0, 64) {
+        knight_attacks[square] = leaper_attacks(square, knight_offsets, 8);
+        king_attacks[square]   = leaper_attacks(square, king_offsets, 8);
+        pawn_attacks[WHITE >> 3][square] = leaper_attacks(square, white_pawn_offsets, 2);
+        pawn_attacks[BLACK >> 3][square] = leaper_attacks(square, black_pawn_offsets, 2);
+    }
+
+    init_slider(rook_magics, rook_table, rook_dirs);
+    init_slider(bishop_magics, bishop_table, bishop_dirs);
+
+    // squares strictly between two squares sharing a rank, file or diagonal.
+    // each slider blocked only by the other square sees exactly the gap between them.
+    for_range(a, 0, 64) {
+        for_range(b, 0, 64) {
+            if (rook_attacks(a, 0) & bit(b)) {
+                squares_between[a][b] = rook_attacks(a, bit(b)) & rook_attacks(b, bit(a));
+            } else if (bishop_attacks(a, 0) & bit(b)) {
+                squares_between[a][b] = bishop_attacks(a, bit(b)) & bishop_attacks(b, bit(a));
+            }
+        }
+    }
+}
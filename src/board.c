@@ -1,5 +1,6 @@
 #include "chess.h"
 #include "term.h"
+#include <stddef.h>
 
 #define BYTE_TO_BINARY_PATTERN "%c%c%c%c%c%c%c%c"
 #define BYTE_TO_BINARY(byte)  \
@@ -16,13 +17,49 @@
 
 void init_board(Board* b) {
     load_board(b, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w");
-    da_init(&b->move_stack, 16);
-    da_init(&b->history, 64);
+}
+
+// the copy can make and undo moves without touching the original.
+// only the part of the move stack in use gets copied.
+void copy_board(Board* dst, Board* src) {
+    memcpy(dst, src, offsetof(Board, move_stack));
+    memcpy(dst->move_stack, src->move_stack, sizeof(src->move_stack[0]) * src->move_stack_len);
+}
+
+// boards dont own any memory anymore, this is only here so callers dont have to care
+void destroy_board(Board* b) {
+}
+
+// if a fen has a castling field, pieces that have lost their rights get marked as moved.
+// without one, every king and rook on its home square is allowed to castle.
+static void apply_castling_rights(Board* b, char* rights) {
+    struct { u8 color; u8 king; u8 rook; char c; } corners[] = {
+        {WHITE, 7*8 + 4, 7*8 + 7, 'K'},
+        {WHITE, 7*8 + 4, 7*8 + 0, 'Q'},
+        {BLACK, 4, 7, 'k'},
+        {BLACK, 4, 0, 'q'},
+    };
+    for_range(i, 0, 4) {
+        if (strchr(rights, corners[i].c) != NULL) continue;
+        if (b->board[corners[i].rook] == (corners[i].color | ROOK)) {
+            b->board[corners[i].rook] |= HAS_MOVED;
+        }
+    }
+    for_range(i, 0, 4) {
+        if (strchr(rights, corners[i].c) != NULL) continue;
+        if (strchr(rights, corners[i ^ 1].c) != NULL) continue;
+        if (b->board[corners[i].king] == (corners[i].color | KING)) {
+            b->board[corners[i].king] |= HAS_MOVED;
+        }
+    }
 }
 
 void load_board(Board* b, char* fen) {
 
     memset(b->board, 0, 64);
+    b->color_to_move = WHITE;
+    b->en_passant = 0;
+    b->move_stack_len = 0;
 
     // assuming well-formed fen strings
     char* cursor = fen;
@@ -63,7 +100,31 @@ void load_board(Board* b, char* fen) {
         }
         cursor++;
     }
+
+    // side to move, castling rights, en passant square. all optional.
+    char fields[3][8] = {};
+    sscanf(cursor, "%7s %7s %7s", fields[0], fields[1], fields[2]);
+
+    if (fields[0][0] == 'b') b->color_to_move = BLACK;
+    if (fields[1][0] != '\0') apply_castling_rights(b, fields[1]);
+
+    recompute_bitboards(b);
+    recompute_eval_terms(b);
+    nnue_refresh(b);
     b->zobrist = zobrist_full_board(b);
+
+    int ep_square = indexof(fields[2]);
+    if (ep_square != -1) b->en_passant = ep_square;
+}
+
+void recompute_bitboards(Board* b) {
+    memset(b->bb, 0, sizeof(b->bb));
+    for_urange(i, 0, 64) {
+        u8 p = b->board[i];
+        if (piece_type(p) == EMPTY) continue;
+        b->bb[p & 0b1111]     |= bit(i);
+        b->bb[piece_color(p)] |= bit(i);
+    }
 }
 
 static char* highlight_spectrum[] = {
@@ -105,7 +166,7 @@ void print_board_debug(Board* b) {
 
 void print_board_w_moveset(Board* b, MoveSet* ms) {
     u8 highlights[64] = {};
-    foreach (Move m, *ms) highlights[m.target] += 1;
+    foreach (Move m, *ms) highlights[move_target(m)] += 1;
     print_board(b, highlights);
 }
 
@@ -180,22 +241,10 @@ void print_board(Board* b, u8* highlights) {
     // printf("    a b c d e f g h  \n");
 }
 
-void history_push(Board* b, u64 zobrist) {
-    da_append(&b->history, zobrist);
-}
-
-void history_pop(Board* b) {
-    if (b->history.len != 0) da_pop(&b->history);
-}
-
-void history_reset(Board* b) {
-    b->history.len = 0;
-}
-
+// has this position come up before, going back to when the board was loaded
 bool history_contains(Board* b, u64 zobrist) {
-    for (int i = b->history.len -2; i >= 0; i--) {
-        // printf("HIST_CONTAINS %p == %p : %d\n", zobrist, b->history.at[i], zobrist == b->history.at[i]);
-        if (zobrist == b->history.at[i]) {
+    for (int i = b->move_stack_len - 1; i >= 0; i--) {
+        if (zobrist == b->move_stack[i].zobrist) {
             return true;
         }
     }
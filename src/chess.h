@@ -2,6 +2,10 @@
 
 #include "orbit.h"
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 enum {
     EMPTY = 0,
 
@@ -21,6 +25,17 @@ enum {
 #define piece_color(p) ((p) & 0b01000)
 #define piece_type(p)  ((p) & 0b00111)
 
+// bitboards. bit N corresponds to board[N], so bit 0 is a8 and bit 63 is h1.
+#define bit(square)  (1ull << (square))
+#define popcount(bb) __builtin_popcountll(bb)
+#define lsb(bb)      __builtin_ctzll(bb)
+
+// iterate over the index of every set bit in a bitboard, lowest first
+#define for_bits(iterator, bits) \
+    for (u64 _bits_##iterator = (bits), iterator = 0; \
+        _bits_##iterator && ((iterator = lsb(_bits_##iterator)), true); \
+        _bits_##iterator &= _bits_##iterator - 1)
+
 enum {
     SPECIAL_NONE = 0,
     SPECIAL_PAWN_DOUBLE,
@@ -33,14 +48,18 @@ enum {
     SPECIAL_PROMOTE_KNIGHT,
 };
 
-typedef struct Move {
-    u8 start;
-    u8 target;
-    u8 special;
-} Move;
+// a move packed into 16 bits: start square in the low 6, target square in the next 6,
+// special in the top 4. a8 to a8 is never a real move, so all zeroes is the null move.
+typedef u16 Move;
+
+#define new_move(start, target, special) ((Move)((start) | (target) << 6 | (special) << 12))
+#define move_start(m)   ((m) & 63)
+#define move_target(m)  (((m) >> 6) & 63)
+#define move_special(m) ((m) >> 12)
 
-#define NULL_MOVE ((Move){0, 0, 0})
-#define is_move_null(m) ((m).start == 0 && (m).target == 0)
+#define NULL_MOVE ((Move)0)
+#define is_move_null(m) ((m) == NULL_MOVE)
+#define moves_equal(a, b) ((a) == (b))
 
 // like a Move but with extra info so it's rewindable.
 // the board has a stack of these so you can undo moves.
@@ -52,37 +71,109 @@ typedef struct GameTick {
 
     bool piece_first_move : 1; // this is a piece's first move. removes HAS_MOVED flag.
     bool white_move : 1;
-    // probably some inefficiency here, think about it later
+
+    u8 en_passant; // the board's en passant square from before the move
+
+    u64 zobrist; // hash from before the move, undo_move puts it back instead of rehashing
 } GameTick;
 
-da_typedef(Move);
-typedef da(Move) MoveSet;
+// longest game the move stack has room for, search included. make_move asserts there is room.
+// front-ends end a game SEARCH_PLY_RESERVE plies short of this, so a search on top of it still fits.
+#define MAX_GAME_PLIES 2048
+#define SEARCH_PLY_RESERVE 256
+
+// no legal position has more moves than this (the record is 218)
+#define MAX_MOVES 256
+
+// move lists are fixed size, so they live on the stack or inside whatever owns them
+// and never touch the allocator. appending doesnt check for room, nothing gets near MAX_MOVES.
+typedef struct MoveSet {
+    Move at[MAX_MOVES];
+    u32 len;
+} MoveSet;
 
-da_typedef(GameTick);
+#define moveset_append(ms, m) ((ms)->at[(ms)->len++] = (m))
 
-da_typedef(u64);
+#define NNUE_INPUTS 768
+#define NNUE_MAX_HIDDEN 512
+
+// first layer of the optional network, one half per perspective (indexed by color >> 3)
+typedef struct NnueAccumulator {
+    i16 values[2][NNUE_MAX_HIDDEN];
+} NnueAccumulator;
 
 typedef struct Board {
     u8 board[64];
 
+    // one bitboard per (color | type), kept in sync with board[] by make_move/undo_move.
+    // the EMPTY slot of each color, bb[WHITE] and bb[BLACK], holds every piece of that color.
+    u64 bb[16];
+
+    // running evaluation terms per color (indexed by color >> 3), also kept in sync by make_move/undo_move.
+    // mg and eg are midgame and endgame value plus placement, phase is shared.
+    int material[2];
+    int mg[2];
+    int eg[2];
+    int phase;
+
+    // only kept up to date on boards that asked for it with nnue_enable,
+    // so players that dont use the network dont pay for it
+    NnueAccumulator nnue;
+    bool nnue_enabled;
+
     u8 color_to_move;
 
-    da(GameTick) move_stack;
+    // square a pawn can capture onto en passant, 0 if there isnt one (a8 never is).
+    // make_move sets it after a double push, the tick keeps the old one for undo_move.
+    u8 en_passant;
 
     u64 zobrist;
 
-    da(u64) history;
+    // every move played since the position was loaded. each tick also holds the hash
+    // from before its move, so this doubles as the position history for repetitions.
+    // kept last so copy_board can skip the unused part.
+    u32 move_stack_len;
+    GameTick move_stack[MAX_GAME_PLIES];
 } Board;
 
+// pawn that just double pushed past the en passant square
+#define en_passant_pawn(b) ((b)->en_passant + ((b)->color_to_move == WHITE ? 8 : -8))
+
 void init_board(Board* b);
 void load_board(Board* b, char* fen);
+void copy_board(Board* dst, Board* src);
+void destroy_board(Board* b);
 void print_board(Board* b, u8* highlights);
 void print_board_debug(Board* b);
 void print_board_w_moveset(Board* b, MoveSet* ms);
+void recompute_bitboards(Board* b);
+void recompute_eval_terms(Board* b);
+
+#define MAX_PHASE 24
+
+extern const int piece_values[8];
+extern const int phase_weights[8];
+extern int mg_table[16][64];
+extern int eg_table[16][64];
+
+void init_eval();
+int tapered_eval(Board* b);
+int tapered_player_eval(void* ctx, Board* b);
+
+// loaded once by the front-end before any game or thread starts, never while boards are in use
+extern bool nnue_loaded;
+
+bool nnue_load(char* path);
+bool nnue_enable(Board* b);
+void nnue_refresh(Board* b);
+void nnue_add_piece(Board* b, u8 piece, u8 square);
+void nnue_remove_piece(Board* b, u8 piece, u8 square);
+int nnue_eval(Board* b);
+int nnue_check_main(int argc, char** argv);
+
+#define pieces(b, color, type) ((b)->bb[(color) | (type)])
+#define occupancy(b)           ((b)->bb[WHITE] | (b)->bb[BLACK])
 
-void history_push(Board* b, u64 zobrist);
-void history_pop(Board* b);
-void history_reset(Board* b);
 bool history_contains(Board* b, u64 zobrist);
 
 int pseudo_legal_moves(Board* b, MoveSet* mv, bool only_captures);
@@ -90,21 +181,90 @@ int filter_illegal_moves(Board* b, MoveSet* mv);
 
 int legal_moves(Board* b, MoveSet* mv);
 int legal_captures(Board* b, MoveSet* mv);
+int legal_quiets(Board* b, MoveSet* mv);
+bool is_legal_move(Board* b, Move m);
+
+// what legal move generation works out about the side to move before generating anything.
+// a caller that generates the same position more than once can work it out once and pass it in.
+typedef struct LegalMasks {
+    bool has_king; // without one, every pseudo-legal move is legal
+    u8   king_sq;
+    u64  checkers;
+    u64  danger;       // squares the king cant step on
+    u64  pinned;
+    u64  pin_line[64]; // where each pinned piece may go, only set for pinned squares
+} LegalMasks;
+
+void legal_masks(Board* b, LegalMasks* lm);
+int legal_captures_masked(Board* b, MoveSet* mv, LegalMasks* lm);
+int legal_quiets_masked(Board* b, MoveSet* mv, LegalMasks* lm);
+bool is_legal_move_masked(Board* b, Move m, LegalMasks* lm);
+
+u64 attackers_to(Board* b, u8 square, u64 occ);
+bool is_square_attacked(Board* b, u8 square, u8 by_color);
+bool is_in_check(Board* b, u8 color);
+int see(Board* b, Move m);
 
 void make_move(Board* b, Move mv, bool swap_colors);
 void undo_move(Board* b, bool swap_colors);
 
 
 int indexof(char* s);
+char* move_string(Move m, char* buf);
+Move parse_move(Board* b, char* text);
 extern char* square_names[];
 
+// a player keeps everything it remembers between moves in a context made by init,
+// so any number of instances can play at once, even in the same process.
 typedef struct Player {
     char* name;
-    void (*init)(); // player initialization function, runs before any evaluations or moves are made
-    int (*eval)(Board*); // board evaluation function (higher is better)
-    Move (*select)(Board*, int*); // move selection function, returns the move it wants to make
+    void* (*init)(); // makes a new instance of the player, runs before any evaluations or moves are made
+    void (*destroy)(void* ctx); // frees an instance made by init
+    int (*eval)(void* ctx, Board*); // board evaluation function (higher is better)
+    Move (*select)(void* ctx, Board*, int*); // move selection function, returns the move it wants to make
 } Player;
 
+// how far the next search may go. set by whatever is driving the players (the uci front-end),
+// a zero field means no limit of that kind. players that dont search just ignore it.
+typedef struct SearchLimits {
+    u64 time[2];      // milliseconds left on each clock, indexed by color >> 3
+    u64 increment[2];
+    int moves_to_go;
+    u64 movetime;
+    int depth;
+    u64 nodes;
+    bool infinite;
+} SearchLimits;
+
+extern SearchLimits search_limits;
+extern atomic_bool search_stop;   // asks a running search to give up and return its best move
+extern atomic_bool search_ponder; // searching on the opponent's time, the clock doesnt start until this clears
+extern _Thread_local Move search_ponder_move; // the reply the last search on this thread expects, NULL_MOVE if it doesnt know
+
+extern size_t engine_hash_mb; // transposition table budget for players that have one
+extern int    engine_threads; // search threads for players that can use them, only the Threads option raises it
+extern bool   engine_log;     // let players print their own debug output
+extern char*  engine_nnue_file; // network the front-end loads at startup, if the file is there
+
+// called by a searching player after every finished iteration, if set.
+// a forced mate is reported as +-(MATE_SCORE - plies to the mate).
+extern void (*search_report)(int depth, int eval, u64 nodes, Move best);
+
+#define MATE_SCORE 100000
+#define MAX_MATE_PLIES 1000
+
+int uci_main(int argc, char** argv);
+int tournament_main(int argc, char** argv);
+
+// only two kings left on the board
+bool is_two_king_draw(Board* b);
+
+u64 perft(Board* b, int depth);
+u64 perft_divide(Board* b, int depth);
+u64 perft_parallel(Board* b, int depth, int threads, u64 hash_mb, bool divide);
+int perft_suite_run(int depth, int threads, u64 hash_mb);
+int perft_main(int argc, char** argv);
+
 u64 genrand64_int64();
 void init_genrand64(u64 seed);
 
@@ -115,6 +275,38 @@ u64 zobrist_full_board(Board* b);
 extern u64 zobrist_values[64 * 32];
 extern u64 zobrist_black_to_move;
 
+// precomputed attack tables, see attack.c
+
+typedef struct Magic {
+    u64* attacks;
+    u64 mask;  // relevant occupancy, edges excluded
+    u64 magic; // unused when indexing with PEXT
+    u8  shift;
+} Magic;
+
+extern u64 knight_attacks[64];
+extern u64 king_attacks[64];
+extern u64 pawn_attacks[2][64]; // indexed by color >> 3
+extern u64 squares_between[64][64]; // exclusive, empty if the squares dont share a line
+
+extern Magic rook_magics[64];
+extern Magic bishop_magics[64];
+
+void init_attacks();
+
+forceinline static u64 magic_lookup(Magic* m, u64 occ) {
+#ifdef __BMI2__
+    return m->attacks[_pext_u64(occ, m->mask)];
+#else
+    return m->attacks[((occ & m->mask) * m->magic) >> m->shift];
+#endif
+}
+
+#define rook_attacks(square, occ)   magic_lookup(&rook_magics[square], (occ))
+#define bishop_attacks(square, occ) magic_lookup(&bishop_magics[square], (occ))
+#define queen_attacks(square, occ)  (rook_attacks(square, occ) | bishop_attacks(square, occ))
+#define pawn_attacks_from(color, square) (pawn_attacks[(color) >> 3][square])
+
 #define swap_color_to_move(b) do { \
     (b).color_to_move = (b).color_to_move == WHITE ? BLACK : WHITE; \
     (b).zobrist ^= zobrist_black_to_move; \
@@ -126,21 +318,48 @@ enum {
     TT_UPPER,
 };
 
+// what a probe hands back. the table itself stores these packed into TransposSlots.
 typedef struct TransposEntry {
     u64 zobrist;
     int eval;
-    u16 depth;
+    u16 depth; // plies searched below this position, not plies from the root
     u8  kind;
+    u8  age; // generation of the search that stored it
+    Move move; // best move or refutation, null if nothing beat alpha
 } TransposEntry;
 
+// one entry as stored. key is the zobrist xor'd with data, so a slot torn
+// by two threads writing at the same time fails verification instead of
+// handing back another position's data. no locks needed.
+typedef struct TransposSlot {
+    _Atomic u64 key;
+    _Atomic u64 data; // eval (24 bits) | move << 24 | depth << 40 | kind << 48 | age << 56
+} TransposSlot;
+
+#define TT_BUCKET_SIZE 4
+
+// one cache line. every slot but the last is depth-preferred, the last is always replaced.
+typedef struct TransposBucket {
+    alignas(64) TransposSlot slots[TT_BUCKET_SIZE];
+} TransposBucket;
+
 typedef struct TransposTable {
-    TransposEntry* at;
-    u64 len;
+    TransposBucket* at;
+    u64 len; // in buckets, always a power of two
+    u8 generation; // bumped every search, stored entries are tagged with it
 } TransposTable;
 
+extern bool ttable_huge_pages;
+
 void ttable_init(TransposTable* tt, u64 len);
+void ttable_init_mb(TransposTable* tt, size_t mb);
+void ttable_resize(TransposTable* tt, size_t mb);
+void ttable_clear(TransposTable* tt);
+void ttable_new_search(TransposTable* tt);
+void ttable_free(TransposTable* tt);
 TransposEntry* ttable_get(TransposTable* tt, u64 zobrist, int depth, int alpha, int beta);
-void ttable_put(TransposTable* tt, u64 zobrist, int eval, u16 depth, u8 kind);
+TransposEntry* ttable_probe(TransposTable* tt, u64 zobrist);
+void ttable_put(TransposTable* tt, u64 zobrist, int eval, u16 depth, u8 kind, Move move);
 
 extern const Player player_random;
 extern const Player player_first;
@@ -155,4 +374,8 @@ extern const Player player_v5;
 extern const Player player_v6;
 extern const Player player_v7;
 extern const Player player_v8;
-extern const Player player_v9;
\ No newline at end of file
+extern const Player player_v9;
+
+// every player the front-ends can pick by name, NULL terminated
+extern const Player* const all_players[];
+const Player* find_player(char* name);
\ No newline at end of file
@@ -1,3 +1,5 @@
+// the one translation unit that pulls in the orbit implementations
+#define ORBIT_IMPLEMENTATION
 #include "chess.h"
 #include <time.h>
 #include <unistd.h>
@@ -9,37 +11,14 @@ void clear_screen() {
 }
 
 bool is_two_king_draw(Board* b) {
-    for_range(i, 0, 64) {
-        if (piece_type(b->board[i]) != KING && piece_type(b->board[i]) != EMPTY) return false;
-    }
-    return true;
-}
-
-bool is_king_in_check(Board* b, u8 piece, u8 color) {
-    piece = piece | color;
-    
-    MoveSet opp_moves = {};
-    da_init(&opp_moves, 32);
-    
-    b->color_to_move = color == WHITE ? BLACK : WHITE;
-    pseudo_legal_moves(b, &opp_moves, true);
-    filter_illegal_moves(b, &opp_moves);
-
-    foreach (Move m, opp_moves) {
-        if ((b->board[m.target] & 0b01111) == piece) {
-            return true;
-        }
-    }
-
-    da_destroy(&opp_moves);
-    return false;
+    return occupancy(b) == (pieces(b, WHITE, KING) | pieces(b, BLACK, KING));
 }
 
 void print_board_with_move(Board* b, Move move) {
     u8 highlights[64] = {};
     if (!is_move_null(move)) {
-        highlights[move.start] = 2;
-        highlights[move.target] = 3;
+        highlights[move_start(move)] = 2;
+        highlights[move_target(move)] = 3;
     }
     print_board(b, highlights);
 }
@@ -48,20 +27,51 @@ void print_move(Board* b, int i, Move move) {
     printf("%d %s :: %s -> %s\n",
         i,
         b->color_to_move ? "black" : "white", 
-        square_names[move.start], 
-        square_names[move.target]);
+        square_names[move_start(move)], 
+        square_names[move_target(move)]);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "perft") == 0) {
+        init_zobrist();
+        init_attacks();
+        init_eval();
+        return perft_main(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "nnuecheck") == 0) {
+        init_zobrist();
+        init_attacks();
+        init_eval();
+        return nnue_check_main(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "uci") == 0) {
+        init_zobrist();
+        init_attacks();
+        init_eval();
+        // before any thread exists, nothing else writes the network
+        nnue_load(engine_nnue_file);
+        return uci_main(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "tournament") == 0) {
+        init_zobrist();
+        init_attacks();
+        init_eval();
+        nnue_load(engine_nnue_file);
+        return tournament_main(argc - 2, argv + 2);
+    }
+
     clear_screen();
     
     const Player* white = &player_user;
     const Player* black = &player_v8;
 
     init_zobrist();
+    init_attacks();
+    init_eval();
+    nnue_load(engine_nnue_file);
 
-    white->init();
-    black->init();
+    void* white_ctx = white->init();
+    void* black_ctx = black->init();
 
     Board b = {};
     init_board(&b);
@@ -78,20 +88,20 @@ int main() {
     int last_white_eval = 0;
     int last_black_eval = 0;
 
-    MoveSet possible_moves = {};
-    da_init(&possible_moves, 64);
+    MoveSet possible_moves;
 
     Move last_move = NULL_MOVE;
     int last_i = 1;
 
     while (true) {
-        da_clear(&possible_moves);
+        possible_moves.len = 0;
         // sleep(5);
         Player* player_to_move = b.color_to_move ? black : white;
         Player* opponent = b.color_to_move ? white : black;
+        void* ctx_to_move = b.color_to_move ? black_ctx : white_ctx;
 
 
-        Move move = player_to_move->select(&b, b.color_to_move ? &black_eval : &white_eval);
+        Move move = player_to_move->select(ctx_to_move, &b, b.color_to_move ? &black_eval : &white_eval);
         clear_screen();
         printf("white '%s' vs black '%s'\n", white->name, black->name);
 
@@ -116,7 +126,7 @@ int main() {
         if (is_move_null(move)) {
             if (possible_moves.len != 0) {
                 printf("error, %s '%s' returned null move", b.color_to_move ? "black" : "white", player_to_move->name);
-            } else if (is_king_in_check(&b, KING, b.color_to_move)) {
+            } else if (is_in_check(&b, b.color_to_move)) {
                 // checkmate
                 printf("checkmate, %s '%s' wins\n", b.color_to_move ? "black" : "white", opponent->name);
             } else {
@@ -145,6 +155,11 @@ int main() {
             printf("stalemate, position repeated\n");
             break;
         }
+        // the move stack has to fit the next search as well
+        if (b.move_stack_len + SEARCH_PLY_RESERVE >= MAX_GAME_PLIES) {
+            printf("draw, move limit reached\n");
+            break;
+        }
 
         last_white_eval = white_eval;
         last_black_eval = black_eval;
@@ -153,4 +168,7 @@ int main() {
         if (!b.color_to_move) i++;
     }
     printf("end\n");
+
+    white->destroy(white_ctx);
+    black->destroy(black_ctx);
 }
\ No newline at end of file
@@ -8,118 +8,413 @@ forceinline static bool is_opponent_piece(Board* b, int i) {
     return piece_type(b->board[i]) != EMPTY && b->color_to_move != piece_color(b->board[i]);
 }
 
-forceinline static bool can_go_here(Board* b, int i) {
-    if (is_occupied(b, i)) return is_opponent_piece(b, i);
-    return true;
-}
-
 forceinline static void add_move(MoveSet* mv, int from, int to, int* num_moves) {
     (*num_moves)++;
     if (mv == NULL) return;
-    Move move = {
-        .start = from,
-        .target = to,
-    };
-    da_append(mv, move);
+    moveset_append(mv, new_move(from, to, SPECIAL_NONE));
 }
 
 forceinline static void add_move_special(MoveSet* mv, int from, int to, int* num_moves, u8 special) {
     (*num_moves)++;
     if (mv == NULL) return;
-    Move move = {
-        .start = from,
-        .target = to,
-        .special = special,
-    };
-    da_append(mv, move);
+    moveset_append(mv, new_move(from, to, special));
 }
 
-int legal_moves(Board* b, MoveSet* mv) {
-    pseudo_legal_moves(b, mv, false);
-    return filter_illegal_moves(b, mv);
+// add a move from one square to every square in a target bitboard
+forceinline static void add_moves_from(MoveSet* mv, int from, u64 targets, int* num_moves) {
+    if (mv == NULL) {
+        *num_moves += popcount(targets);
+        return;
+    }
+    for_bits(to, targets) add_move(mv, from, to, num_moves);
 }
 
-int legal_captures(Board* b, MoveSet* mv) {
-    pseudo_legal_moves(b, mv, true);
-    return filter_illegal_moves(b, mv);
+// every piece (of either color) that attacks a square, given some occupancy
+u64 attackers_to(Board* b, u8 square, u64 occ) {
+    return
+        (pawn_attacks_from(WHITE, square) & pieces(b, BLACK, PAWN)) |
+        (pawn_attacks_from(BLACK, square) & pieces(b, WHITE, PAWN)) |
+        (knight_attacks[square] & (pieces(b, WHITE, KNIGHT) | pieces(b, BLACK, KNIGHT))) |
+        (king_attacks[square]   & (pieces(b, WHITE, KING)   | pieces(b, BLACK, KING))) |
+        (bishop_attacks(square, occ) & (pieces(b, WHITE, BISHOP) | pieces(b, BLACK, BISHOP) |
+                                        pieces(b, WHITE, QUEEN)  | pieces(b, BLACK, QUEEN))) |
+        (rook_attacks(square, occ)   & (pieces(b, WHITE, ROOK)   | pieces(b, BLACK, ROOK) |
+                                        pieces(b, WHITE, QUEEN)  | pieces(b, BLACK, QUEEN)));
 }
 
-int filter_illegal_moves(Board* b, MoveSet* mv) {
-    static MoveSet opponent_responses = {};
-    if (opponent_responses.at == NULL) {
-        da_init(&opponent_responses, 64);
+// work backwards from the square, stopping at the first attacker found
+bool is_square_attacked(Board* b, u8 square, u8 by_color) {
+    if (pawn_attacks_from(by_color ^ BLACK, square) & pieces(b, by_color, PAWN)) return true;
+    if (knight_attacks[square] & pieces(b, by_color, KNIGHT)) return true;
+    if (king_attacks[square] & pieces(b, by_color, KING)) return true;
+
+    u64 occupied = occupancy(b);
+    u64 queens = pieces(b, by_color, QUEEN);
+    if (bishop_attacks(square, occupied) & (pieces(b, by_color, BISHOP) | queens)) return true;
+    if (rook_attacks(square, occupied)   & (pieces(b, by_color, ROOK)   | queens)) return true;
+    return false;
+}
+
+bool is_in_check(Board* b, u8 color) {
+    u64 king = pieces(b, color, KING);
+    if (king == 0) return false;
+    return is_square_attacked(b, lsb(king), color ^ BLACK);
+}
+
+// every square attacked by one side, given some occupancy
+static u64 attacked_squares(Board* b, u8 color, u64 occ) {
+    u64 attacked = 0;
+    for_bits(i, pieces(b, color, PAWN))   attacked |= pawn_attacks_from(color, i);
+    for_bits(i, pieces(b, color, KNIGHT)) attacked |= knight_attacks[i];
+    for_bits(i, pieces(b, color, BISHOP) | pieces(b, color, QUEEN)) attacked |= bishop_attacks(i, occ);
+    for_bits(i, pieces(b, color, ROOK)   | pieces(b, color, QUEEN)) attacked |= rook_attacks(i, occ);
+    for_bits(i, pieces(b, color, KING))   attacked |= king_attacks[i];
+    return attacked;
+}
+
+forceinline static void add_promotions(MoveSet* mv, int from, u64 targets, int* num_moves) {
+    for_bits(to, targets) {
+        add_move_special(mv, from, to, num_moves, SPECIAL_PROMOTE_QUEEN);
+        add_move_special(mv, from, to, num_moves, SPECIAL_PROMOTE_ROOK);
+        add_move_special(mv, from, to, num_moves, SPECIAL_PROMOTE_BISHOP);
+        add_move_special(mv, from, to, num_moves, SPECIAL_PROMOTE_KNIGHT);
     }
-    da_clear(&opponent_responses);
+}
 
-    swap_color_to_move(*b);
-    pseudo_legal_moves(b, &opponent_responses, false);
-    swap_color_to_move(*b);
+// what generate_legal should produce. captures include en passant,
+// quiets are everything else (pushes, promotions onto empty squares, castling).
+enum {
+    GEN_ALL,
+    GEN_CAPTURES,
+    GEN_QUIETS,
+};
 
-    bool host_in_check = false;
-    foreach (Move opp, opponent_responses) {
-        if (piece_type(b->board[opp.target]) == KING) {
-            host_in_check = true;
-            break;
+// the king-less fallback is pseudo-legal and doesnt know about quiets,
+// so generate everything and drop the captures afterwards
+static int pseudo_legal_quiets(Board* b, MoveSet* mv) {
+    if (mv == NULL) return pseudo_legal_moves(b, NULL, false) - pseudo_legal_moves(b, NULL, true);
+
+    size_t start = mv->len;
+    pseudo_legal_moves(b, mv, false);
+
+    size_t kept = start;
+    for_range(i, start, mv->len) {
+        Move m = mv->at[i];
+        if (is_occupied(b, move_target(m)) || move_special(m) == SPECIAL_EN_PASSANT) continue;
+        mv->at[kept++] = m;
+    }
+    int num_moves = kept - start;
+    mv->len = kept;
+    return num_moves;
+}
+
+// checkers, pinned pieces and the squares the king cant step on, for the side to move
+void legal_masks(Board* b, LegalMasks* lm) {
+    u8 us   = b->color_to_move;
+    u8 them = us ^ BLACK;
+
+    u64 own      = b->bb[us];
+    u64 occupied = own | b->bb[them];
+
+    lm->has_king = pieces(b, us, KING) != 0;
+    if (!lm->has_king) return;
+
+    u8 king_sq = lsb(pieces(b, us, KING));
+    lm->king_sq  = king_sq;
+    lm->checkers = attackers_to(b, king_sq, occupied) & b->bb[them];
+
+    // the king is taken off the board so it cant hide behind itself along a slider's ray
+    lm->danger = attacked_squares(b, them, occupied ^ bit(king_sq));
+
+    // pinned pieces may only move along the line between the king and the pinner
+    lm->pinned = 0;
+    u64 snipers =
+        (rook_attacks(king_sq, 0)   & (pieces(b, them, ROOK)   | pieces(b, them, QUEEN))) |
+        (bishop_attacks(king_sq, 0) & (pieces(b, them, BISHOP) | pieces(b, them, QUEEN)));
+    for_bits(s, snipers) {
+        u64 blockers = squares_between[king_sq][s] & occupied;
+        if (popcount(blockers) == 1 && (blockers & own)) {
+            lm->pinned |= blockers;
+            lm->pin_line[lsb(blockers)] = squares_between[king_sq][s] | bit(s);
         }
     }
+}
 
-    int legal_moves_count = 0;
+// generate only legal moves, without making any of them.
+// every piece's targets get masked by the check and pin masks from legal_masks.
+// only pieces on from_mask get their moves generated.
+static int generate_legal(Board* b, MoveSet* mv, u8 gen, u64 from_mask, LegalMasks* lm) {
+    u8 us   = b->color_to_move;
+    u8 them = us ^ BLACK;
+
+    u64 own      = b->bb[us];
+    u64 opponent = b->bb[them];
+    u64 occupied = own | opponent;
+
+    // nothing to keep safe, every pseudo-legal move goes
+    if (!lm->has_king) {
+        if (gen == GEN_QUIETS) return pseudo_legal_quiets(b, mv);
+        return pseudo_legal_moves(b, mv, gen == GEN_CAPTURES);
+    }
 
+    u8  king_sq  = lm->king_sq;
+    u64 checkers = lm->checkers;
+    u64 danger   = lm->danger;
+    u64 pinned   = lm->pinned;
 
-    for_range(i, 0, mv->len) {
-        Move m = mv->at[i];
+    // when in check, everything but the king has to capture the checker or block it
+    u64 check_mask = ~0ull;
+    if (checkers != 0) {
+        check_mask = checkers | squares_between[king_sq][lsb(checkers)];
+    }
+    bool double_check = popcount(checkers) > 1;
+
+    u64 targets_allowed = ~own;
+    if (gen == GEN_CAPTURES) targets_allowed = opponent;
+    if (gen == GEN_QUIETS)   targets_allowed = ~occupied;
 
-        bool skip_move = false;
+    u64 allowed = targets_allowed & check_mask;
 
-        // cant castle out of check
-        if ((m.special == SPECIAL_KINGSIDE_CASTLE || m.special == SPECIAL_QUEENSIDE_CASTLE) && host_in_check) {
+    int num_moves = 0;
+    for_bits(i, own & from_mask) {
+        u8 type = piece_type(b->board[i]);
+
+        if (type == KING) {
+            u64 targets = king_attacks[i] & ~danger & targets_allowed;
+            add_moves_from(mv, i, targets, &num_moves);
             continue;
         }
+        if (double_check) continue;
 
-        u8 col = b->color_to_move;
-        make_move(b, m, true);
-        da_clear(&opponent_responses);
-        pseudo_legal_moves(b, &opponent_responses, false);
-
-        foreach (Move opp, opponent_responses) {
+        u64 mask = allowed;
+        if (pinned & bit(i)) mask &= lm->pin_line[i];
 
-            // cant castle through check
-            if (m.special == SPECIAL_KINGSIDE_CASTLE) {
-                if (col == WHITE) {
-                    if (opp.target == 7*8 + 5) {
-                        skip_move = true;
-                        goto skip;
-                    }
-                } else {
-                    if (opp.target == 5) {
-                        skip_move = true;
-                        goto skip;
-                    }
-                }
-            } else
-            if (m.special == SPECIAL_QUEENSIDE_CASTLE) {
-                if (col == WHITE) {
-                    if (opp.target == 7*8 + 3) {
-                        skip_move = true;
-                        goto skip;
-                    }
-                } else {
-                    if (opp.target == 3) {
-                        skip_move = true;
-                        goto skip;
-                    }
+        switch (type) {
+        case PAWN: {
+            int forward = us == WHITE ? -8 : 8;
+            u64 promotion_rank = us == WHITE ? 0x00000000000000FFull : 0xFF00000000000000ull;
+            bool on_start_rank = us == WHITE ? i >= 48 : i < 16;
+
+            u64 captures = 0;
+            if (gen != GEN_QUIETS) captures = pawn_attacks_from(us, i) & opponent & mask;
+            u64 pushes = 0;
+            if (gen != GEN_CAPTURES && !(occupied & bit(i + forward))) {
+                pushes = bit(i + forward);
+                if (on_start_rank && !(occupied & bit(i + 2 * forward)) && (mask & bit(i + 2 * forward))) {
+                    add_move_special(mv, i, i + 2 * forward, &num_moves, SPECIAL_PAWN_DOUBLE);
                 }
+                pushes &= mask;
+            }
+
+            add_promotions(mv, i, (captures | pushes) & promotion_rank, &num_moves);
+            add_moves_from(mv, i, (captures | pushes) & ~promotion_rank, &num_moves);
+
+            // en passant. the pawn that just double pushed has to be right beside us
+            if (gen == GEN_QUIETS || b->en_passant == 0) break;
+            int victim = en_passant_pawn(b);
+            if (victim / 8 != i / 8 || (victim != i - 1 && victim != i + 1)) break;
+            if (!(pieces(b, them, PAWN) & bit(victim))) break;
+
+            // both pawns leave their rank at once, so check the king by hand
+            // instead of trusting the pin and check masks
+            int target = b->en_passant;
+            u64 after = (occupied ^ bit(i) ^ bit(victim)) | bit(target);
+            u64 attackers = attackers_to(b, king_sq, after) & opponent & ~bit(victim);
+            if (attackers == 0) {
+                add_move_special(mv, i, target, &num_moves, SPECIAL_EN_PASSANT);
             }
+        } break;
+        case QUEEN:  add_moves_from(mv, i, queen_attacks(i, occupied) & mask, &num_moves); break;
+        case ROOK:   add_moves_from(mv, i, rook_attacks(i, occupied) & mask, &num_moves); break;
+        case BISHOP: add_moves_from(mv, i, bishop_attacks(i, occupied) & mask, &num_moves); break;
+        case KNIGHT: add_moves_from(mv, i, knight_attacks[i] & mask, &num_moves); break;
+        default:
+            break;
+        }
+    }
 
-            // cant move into check
-            if (piece_type(b->board[opp.target]) == KING) {
-                skip_move = true;
-                goto skip;
+    // castling. the king cant castle out of, through, or into check
+    if (gen != GEN_CAPTURES && checkers == 0 && (from_mask & bit(king_sq))) {
+        u8 back = us == WHITE ? 7*8 : 0;
+        if (b->board[back + 4] == (us | KING)) {
+            if (b->board[back + 7] == (us | ROOK) &&
+                !(occupied & (bit(back + 5) | bit(back + 6))) &&
+                !(danger   & (bit(back + 5) | bit(back + 6)))) {
+                    add_move_special(mv, back + 4, back + 6, &num_moves, SPECIAL_KINGSIDE_CASTLE);
             }
+            if (b->board[back + 0] == (us | ROOK) &&
+                !(occupied & (bit(back + 1) | bit(back + 2) | bit(back + 3))) &&
+                !(danger   & (bit(back + 2) | bit(back + 3)))) {
+                    add_move_special(mv, back + 4, back + 2, &num_moves, SPECIAL_QUEENSIDE_CASTLE);
+            }
+        }
+    }
+
+    return num_moves;
+}
+
+forceinline static int promotion_type(u8 special) {
+    switch (special) {
+    case SPECIAL_PROMOTE_QUEEN:  return QUEEN;
+    case SPECIAL_PROMOTE_ROOK:   return ROOK;
+    case SPECIAL_PROMOTE_BISHOP: return BISHOP;
+    case SPECIAL_PROMOTE_KNIGHT: return KNIGHT;
+    }
+    return EMPTY;
+}
+
+// static exchange evaluation. plays out every capture on the target square,
+// each side always recapturing with its least valuable piece, and returns
+// the material the move wins (or loses, if negative) for the side making it.
+// either side can stop capturing whenever that is better for it. pins are ignored.
+int see(Board* b, Move m) {
+    int gain[32];
+    int d = 0;
+
+    u8 target = move_target(m);
+    u8 moving = piece_type(b->board[move_start(m)]);
+    u64 occ = occupancy(b) ^ bit(move_start(m));
+
+    if (move_special(m) == SPECIAL_EN_PASSANT) {
+        int captured_square = b->color_to_move == WHITE ? target + 8 : target - 8;
+        occ ^= bit(captured_square);
+        gain[0] = piece_values[PAWN];
+    } else {
+        gain[0] = piece_values[piece_type(b->board[target])];
+    }
+
+    u8 promoted = promotion_type(move_special(m));
+    if (promoted != EMPTY) {
+        gain[0] += piece_values[promoted] - piece_values[PAWN];
+        moving = promoted;
+    }
+
+    u64 diagonal = pieces(b, WHITE, BISHOP) | pieces(b, BLACK, BISHOP) | pieces(b, WHITE, QUEEN) | pieces(b, BLACK, QUEEN);
+    u64 straight = pieces(b, WHITE, ROOK)   | pieces(b, BLACK, ROOK)   | pieces(b, WHITE, QUEEN) | pieces(b, BLACK, QUEEN);
+
+    u64 attackers = attackers_to(b, target, occ) & occ;
+    u8 side = b->color_to_move ^ BLACK;
+
+    while (true) {
+        u64 side_attackers = attackers & b->bb[side];
+        if (side_attackers == 0) break;
+
+        // least valuable attacker
+        static const u8 cheapest_first[6] = {PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING};
+        u8 type = EMPTY;
+        u64 from = 0;
+        for_range(i, 0, 6) {
+            from = side_attackers & pieces(b, side, cheapest_first[i]);
+            if (from != 0) {
+                type = cheapest_first[i];
+                break;
+            }
+        }
+
+        // the king cant take if the other side would just take it back
+        if (type == KING && (attackers & b->bb[side ^ BLACK])) break;
+
+        // this side takes whatever was last moved onto the square.
+        // a pawn taking on the last rank promotes, and always to a queen
+        d++;
+        gain[d] = piece_values[moving] - gain[d - 1];
+        moving = type;
+        if (type == PAWN && (target < 8 || target >= 56)) {
+            gain[d] += piece_values[QUEEN] - piece_values[PAWN];
+            moving = QUEEN;
+        }
+        if (d == 31) break;
+
+        // take the capturer off the board, which might uncover a slider behind it
+        occ ^= from & -from;
+        attackers |= (bishop_attacks(target, occ) & diagonal) | (rook_attacks(target, occ) & straight);
+        attackers &= occ;
+
+        side ^= BLACK;
+    }
+
+    // negamax back up the sequence, either side can choose to stand pat
+    while (d > 0) {
+        gain[d - 1] = -max(-gain[d - 1], gain[d]);
+        d--;
+    }
+    return gain[0];
+}
+
+int legal_moves(Board* b, MoveSet* mv) {
+    LegalMasks lm;
+    legal_masks(b, &lm);
+    return generate_legal(b, mv, GEN_ALL, ~0ull, &lm);
+}
+
+int legal_captures(Board* b, MoveSet* mv) {
+    LegalMasks lm;
+    legal_masks(b, &lm);
+    return generate_legal(b, mv, GEN_CAPTURES, ~0ull, &lm);
+}
+
+int legal_quiets(Board* b, MoveSet* mv) {
+    LegalMasks lm;
+    legal_masks(b, &lm);
+    return generate_legal(b, mv, GEN_QUIETS, ~0ull, &lm);
+}
+
+bool is_legal_move(Board* b, Move m) {
+    LegalMasks lm;
+    legal_masks(b, &lm);
+    return is_legal_move_masked(b, m, &lm);
+}
+
+// the same three, with masks the caller already worked out for this position
+
+int legal_captures_masked(Board* b, MoveSet* mv, LegalMasks* lm) {
+    return generate_legal(b, mv, GEN_CAPTURES, ~0ull, lm);
+}
+
+int legal_quiets_masked(Board* b, MoveSet* mv, LegalMasks* lm) {
+    return generate_legal(b, mv, GEN_QUIETS, ~0ull, lm);
+}
+
+// check a move from somewhere else (the transposition table, another node's killers)
+// by generating the legal moves of just the piece on its start square
+bool is_legal_move_masked(Board* b, Move m, LegalMasks* lm) {
+    if (!(b->bb[b->color_to_move] & bit(move_start(m)))) return false;
+
+    MoveSet ms;
+    ms.len = 0;
+    generate_legal(b, &ms, GEN_ALL, bit(move_start(m)), lm);
+
+    foreach (Move legal, ms) {
+        if (moves_equal(legal, m)) return true;
+    }
+    return false;
+}
+
+// drop the pseudo-legal moves that leave the king attacked.
+// asks the attack tables instead of generating every reply, so theres no scratch list to share.
+int filter_illegal_moves(Board* b, MoveSet* mv) {
+    u8 col = b->color_to_move;
+    bool host_in_check = is_in_check(b, col);
+
+    int legal_moves_count = 0;
+
+    for_range(i, 0, mv->len) {
+        Move m = mv->at[i];
+
+        if (move_special(m) == SPECIAL_KINGSIDE_CASTLE || move_special(m) == SPECIAL_QUEENSIDE_CASTLE) {
+            // cant castle out of check
+            if (host_in_check) continue;
+
+            // cant castle through check
+            u8 passed = move_special(m) == SPECIAL_KINGSIDE_CASTLE ? move_start(m) + 1 : move_start(m) - 1;
+            if (is_square_attacked(b, passed, col ^ BLACK)) continue;
         }
-        skip:
+
+        // cant move into check
+        make_move(b, m, false);
+        bool skip_move = is_in_check(b, col);
         undo_move(b, false);
-        swap_color_to_move(*b);
+
         if (!skip_move) {
             mv->at[legal_moves_count] = m;
             legal_moves_count++;
@@ -130,15 +425,15 @@ int filter_illegal_moves(Board* b, MoveSet* mv) {
     return legal_moves_count;
 }
 
-#define if_capture(target) if (!only_captures || b->board[target] != EMPTY)
-
 int pseudo_legal_moves(Board* b, MoveSet* mv, bool only_captures) {
     int num_moves = 0;
-    for_range(i, 0, 64) {
-        // skip looking at pieces that arent of the moving color
-        if (piece_color(b->board[i]) != b->color_to_move) continue;
-        if (piece_type(b->board[i]) == EMPTY) continue;
 
+    u64 occupied = occupancy(b);
+    u64 opponent = b->bb[b->color_to_move ^ BLACK];
+    u64 allowed  = only_captures ? opponent : ~b->bb[b->color_to_move];
+
+    // only look at pieces of the moving color
+    for_bits(i, b->bb[b->color_to_move]) {
         int squares_on_left = i % 8;
         int squares_on_right = 7 - squares_on_left;
         int squares_on_top = i / 8;
@@ -172,14 +467,12 @@ int pseudo_legal_moves(Board* b, MoveSet* mv, bool only_captures) {
                 }
                 // en passant
                 if (squares_on_left != 0 && ((b->board[i - 1] & 0b1111) == (BLACK | PAWN))) {
-                    GameTick last_move = b->move_stack.at[b->move_stack.len - 1];
-                    if (last_move.move.special == SPECIAL_PAWN_DOUBLE && last_move.move.target == i - 1) {
+                    if (b->en_passant != 0 && b->en_passant == i - 1 - 8) {
                         add_move_special(mv, i, i - 1 - 8, &num_moves, SPECIAL_EN_PASSANT);
                     }
                 }
                 if (squares_on_right != 0 && ((b->board[i + 1] & 0b1111) == (BLACK | PAWN))) {
-                    GameTick last_move = b->move_stack.at[b->move_stack.len - 1];
-                    if (last_move.move.special == SPECIAL_PAWN_DOUBLE && last_move.move.target == i + 1) {
+                    if (b->en_passant != 0 && b->en_passant == i + 1 - 8) {
                         add_move_special(mv, i, i + 1 - 8, &num_moves, SPECIAL_EN_PASSANT);
                     }
                 }
@@ -224,14 +517,12 @@ int pseudo_legal_moves(Board* b, MoveSet* mv, bool only_captures) {
                 }
                 // en passant
                 if (squares_on_left != 0 && ((b->board[i - 1] & 0b1111) == (WHITE | PAWN))) {
-                    GameTick last_move = b->move_stack.at[b->move_stack.len - 1];
-                    if (last_move.move.special == SPECIAL_PAWN_DOUBLE && last_move.move.target == i - 1) {
+                    if (b->en_passant != 0 && b->en_passant == i - 1 + 8) {
                         add_move_special(mv, i, i - 1 + 8, &num_moves, SPECIAL_EN_PASSANT);
                     }
                 }
                 if (squares_on_right != 0 && ((b->board[i + 1] & 0b1111) == (WHITE | PAWN))) {
-                    GameTick last_move = b->move_stack.at[b->move_stack.len - 1];
-                    if (last_move.move.special == SPECIAL_PAWN_DOUBLE && last_move.move.target == i + 1) {
+                    if (b->en_passant != 0 && b->en_passant == i + 1 + 8) {
                         add_move_special(mv, i, i + 1 + 8, &num_moves, SPECIAL_EN_PASSANT);
                     }
                 }
@@ -251,104 +542,11 @@ int pseudo_legal_moves(Board* b, MoveSet* mv, bool only_captures) {
                 }
             }
         } break;
-        case QUEEN:
-        case ROOK: {
-            for_range_incl (t, 1, squares_on_left) {
-                int target = i - t;
-                if (is_occupied(b, target)) {
-                    if (is_opponent_piece(b, target)) add_move(mv, i, target, &num_moves);
-                    break;
-                }
-                if (!only_captures) add_move(mv, i, target, &num_moves);
-            }
-            for_range_incl (t, 1, squares_on_right) {
-                int target = i + t;
-                if (is_occupied(b, target)) {
-                    if (is_opponent_piece(b, target)) add_move(mv, i, target, &num_moves);
-                    break;
-                }
-                if (!only_captures) add_move(mv, i, target, &num_moves);
-            }
-            for_range_incl (t, 1, squares_on_top) {
-                int target = i - t * 8;
-                if (is_occupied(b, target)) {
-                    if (is_opponent_piece(b, target)) add_move(mv, i, target, &num_moves);
-                    break;
-                }
-                if (!only_captures) add_move(mv, i, target, &num_moves);
-            }
-            for_range_incl (t, 1, squares_on_bottom) {
-                int target = i + t * 8;
-                if (is_occupied(b, target)) {
-                    if (is_opponent_piece(b, target)) add_move(mv, i, target, &num_moves);
-                    break;
-                }
-                if (!only_captures) add_move(mv, i, target, &num_moves);
-            }
-            if (piece_type(b->board[i]) != QUEEN) break;
-        } 
-        case BISHOP: {
-            int squares_top_right = min(squares_on_top, squares_on_right);
-            int squares_bot_right = min(squares_on_bottom, squares_on_right);
-            int squares_top_left  = min(squares_on_top, squares_on_left);
-            int squares_bot_left  = min(squares_on_bottom, squares_on_left);
-
-            for_range_incl (t, 1, squares_top_right) {
-                int target = i + t - t * 8;
-                if (is_occupied(b, target)) {
-                    if (is_opponent_piece(b, target)) add_move(mv, i, target, &num_moves);
-                    break;
-                }
-                if (!only_captures) add_move(mv, i, target, &num_moves);
-            }
-            for_range_incl (t, 1, squares_top_left) {
-                int target = i - t - t * 8;
-                if (is_occupied(b, target)) {
-                    if (is_opponent_piece(b, target)) add_move(mv, i, target, &num_moves);
-                    break;
-                }
-                if (!only_captures) add_move(mv, i, target, &num_moves);
-            }
-            for_range_incl (t, 1, squares_bot_right) {
-                int target = i + t + t * 8;
-                if (is_occupied(b, target)) {
-                    if (is_opponent_piece(b, target)) add_move(mv, i, target, &num_moves);
-                    break;
-                }
-                if (!only_captures) add_move(mv, i, target, &num_moves);
-            }
-            for_range_incl (t, 1, squares_bot_left) {
-                int target = i - t + t * 8;
-                if (is_occupied(b, target)) {
-                    if (is_opponent_piece(b, target)) add_move(mv, i, target, &num_moves);
-                    break;
-                }
-                if (!only_captures) add_move(mv, i, target, &num_moves);
-            }
-        } break;
-        case KNIGHT: {
-            // quite possibly stupid
-            if (squares_on_top    >= 2 && squares_on_left  >= 1 && can_go_here(b, i - 1 - 8 * 2)) if_capture(i - 1 - 8 * 2) add_move(mv, i, i - 1 - 8 * 2, &num_moves);
-            if (squares_on_top    >= 2 && squares_on_right >= 1 && can_go_here(b, i + 1 - 8 * 2)) if_capture(i + 1 - 8 * 2) add_move(mv, i, i + 1 - 8 * 2, &num_moves);
-            if (squares_on_bottom >= 2 && squares_on_left  >= 1 && can_go_here(b, i - 1 + 8 * 2)) if_capture(i - 1 + 8 * 2) add_move(mv, i, i - 1 + 8 * 2, &num_moves);
-            if (squares_on_bottom >= 2 && squares_on_right >= 1 && can_go_here(b, i + 1 + 8 * 2)) if_capture(i + 1 + 8 * 2) add_move(mv, i, i + 1 + 8 * 2, &num_moves);
-            if (squares_on_top    >= 1 && squares_on_left  >= 2 && can_go_here(b, i - 2 - 8 * 1)) if_capture(i - 2 - 8 * 1) add_move(mv, i, i - 2 - 8 * 1, &num_moves);
-            if (squares_on_top    >= 1 && squares_on_right >= 2 && can_go_here(b, i + 2 - 8 * 1)) if_capture(i + 2 - 8 * 1) add_move(mv, i, i + 2 - 8 * 1, &num_moves);
-            if (squares_on_bottom >= 1 && squares_on_left  >= 2 && can_go_here(b, i - 2 + 8 * 1)) if_capture(i - 2 + 8 * 1) add_move(mv, i, i - 2 + 8 * 1, &num_moves);
-            if (squares_on_bottom >= 1 && squares_on_right >= 2 && can_go_here(b, i + 2 + 8 * 1)) if_capture(i + 2 + 8 * 1) add_move(mv, i, i + 2 + 8 * 1, &num_moves);
-        } break;
-        case KING: {
-            // printf("\n\n%d %d %d %d\n\n", squares_on_top, squares_on_bottom, squares_on_left, squares_on_right);
-            if (squares_on_top    >= 1 && can_go_here(b, i - 8)) if_capture(i - 8) add_move(mv, i, i - 8, &num_moves);
-            if (squares_on_bottom >= 1 && can_go_here(b, i + 8)) if_capture(i + 8) add_move(mv, i, i + 8, &num_moves);
-            if (squares_on_left   >= 1 && can_go_here(b, i - 1)) if_capture(i - 1) add_move(mv, i, i - 1, &num_moves);
-            if (squares_on_right  >= 1 && can_go_here(b, i + 1)) if_capture(i + 1) add_move(mv, i, i + 1, &num_moves);
-        
-            if (squares_on_top    >= 1 && squares_on_right >= 1 && can_go_here(b, i - 8 + 1)) if_capture(i - 8 + 1) add_move(mv, i, i - 8 + 1, &num_moves);
-            if (squares_on_top    >= 1 && squares_on_left  >= 1 && can_go_here(b, i - 8 - 1)) if_capture(i - 8 - 1) add_move(mv, i, i - 8 - 1, &num_moves);
-            if (squares_on_bottom >= 1 && squares_on_right >= 1 && can_go_here(b, i + 8 + 1)) if_capture(i + 8 + 1) add_move(mv, i, i + 8 + 1, &num_moves);
-            if (squares_on_bottom >= 1 && squares_on_left  >= 1 && can_go_here(b, i + 8 - 1)) if_capture(i + 8 - 1) add_move(mv, i, i + 8 - 1, &num_moves);
-        } break;
+        case QUEEN:  add_moves_from(mv, i, queen_attacks(i, occupied) & allowed, &num_moves); break;
+        case ROOK:   add_moves_from(mv, i, rook_attacks(i, occupied) & allowed, &num_moves); break;
+        case BISHOP: add_moves_from(mv, i, bishop_attacks(i, occupied) & allowed, &num_moves); break;
+        case KNIGHT: add_moves_from(mv, i, knight_attacks[i] & allowed, &num_moves); break;
+        case KING:   add_moves_from(mv, i, king_attacks[i] & allowed, &num_moves); break;
         default:
             break;
         }
@@ -389,169 +587,165 @@ int pseudo_legal_moves(Board* b, MoveSet* mv, bool only_captures) {
     return num_moves;
 }
 
-static void zobrist_set(Board* b, u8 piece, u8 position) {
+// replace whatever is on a square, keeping the bitboards, eval terms and network accumulator in sync.
+// undo_move uses this directly, it puts the old hash back in one go.
+forceinline static void set_square_unhashed(Board* b, u8 piece, u8 position) {
+    u8 old = b->board[position];
+    if (old != EMPTY) {
+        b->bb[old & 0b1111]     ^= bit(position);
+        b->bb[piece_color(old)] ^= bit(position);
+        b->material[piece_color(old) >> 3] -= piece_values[piece_type(old)];
+        b->mg[piece_color(old) >> 3] -= mg_table[old & 0b1111][position];
+        b->eg[piece_color(old) >> 3] -= eg_table[old & 0b1111][position];
+        b->phase -= phase_weights[piece_type(old)];
+        if (b->nnue_enabled) nnue_remove_piece(b, old, position);
+    }
+    if (piece != EMPTY) {
+        b->bb[piece & 0b1111]     ^= bit(position);
+        b->bb[piece_color(piece)] ^= bit(position);
+        b->material[piece_color(piece) >> 3] += piece_values[piece_type(piece)];
+        b->mg[piece_color(piece) >> 3] += mg_table[piece & 0b1111][position];
+        b->eg[piece_color(piece) >> 3] += eg_table[piece & 0b1111][position];
+        b->phase += phase_weights[piece_type(piece)];
+        if (b->nnue_enabled) nnue_add_piece(b, piece, position);
+    }
+    b->board[position] = piece;
+}
+
+// same, but keeping the zobrist hash in sync too
+forceinline static void set_square(Board* b, u8 piece, u8 position) {
     b->zobrist ^= zobrist_component(b->board[position], position);
     b->zobrist ^= zobrist_component(piece, position);
+    set_square_unhashed(b, piece, position);
 }
 
 void make_move(Board* b, Move mv, bool swap_colors) {
-    // printf("MOVE start %s target %s special %d\n", square_names[mv.start], square_names[mv.target], mv.special);
+    // printf("MOVE start %s target %s special %d\n", square_names[move_start(mv)], square_names[move_target(mv)], move_special(mv));
 
     GameTick gt = {};
     gt.move = mv;
     gt.white_move = b->color_to_move == WHITE;
+    gt.zobrist = b->zobrist;
+    gt.en_passant = b->en_passant;
 
-    u8 start_piece  = b->board[mv.start];
-    u8 target_piece = b->board[mv.target];
+    u8 start_piece  = b->board[move_start(mv)];
+    u8 target_piece = b->board[move_target(mv)];
 
     if (target_piece != EMPTY) {
-        gt.captured = b->board[mv.target];
-        gt.capture_location = mv.target;
+        gt.captured = b->board[move_target(mv)];
+        gt.capture_location = move_target(mv);
     }
 
-    if (!(b->board[mv.start] & HAS_MOVED)) {
+    if (!(b->board[move_start(mv)] & HAS_MOVED)) {
         gt.piece_first_move = true;
     }
 
-    zobrist_set(b, start_piece | HAS_MOVED, mv.target);
-    b->board[mv.target] = start_piece | HAS_MOVED;
-    zobrist_set(b, EMPTY, mv.start);
-    b->board[mv.start] = EMPTY;
+    set_square(b, start_piece | HAS_MOVED, move_target(mv));
+    set_square(b, EMPTY, move_start(mv));
 
 
-    switch (mv.special) {
+    switch (move_special(mv)) {
     case SPECIAL_KINGSIDE_CASTLE:
-        if (piece_color(b->board[mv.target]) == WHITE) {
-            zobrist_set(b, EMPTY, 7*8 + 7);
-            b->board[7*8 + 7] = EMPTY;
-            zobrist_set(b, (WHITE | ROOK | HAS_MOVED), 7*8 + 5);
-            b->board[7*8 + 5] = (WHITE | ROOK | HAS_MOVED);
+        if (piece_color(b->board[move_target(mv)]) == WHITE) {
+            set_square(b, EMPTY, 7*8 + 7);
+            set_square(b, (WHITE | ROOK | HAS_MOVED), 7*8 + 5);
         } else {
-            zobrist_set(b, EMPTY, 7);
-            b->board[7] = EMPTY;
-            zobrist_set(b, (BLACK | ROOK | HAS_MOVED), 5);
-            b->board[5] = (BLACK | ROOK | HAS_MOVED);
+            set_square(b, EMPTY, 7);
+            set_square(b, (BLACK | ROOK | HAS_MOVED), 5);
         }
         break;
     case SPECIAL_QUEENSIDE_CASTLE:
-        if (piece_color(b->board[mv.target]) == WHITE) {
-            zobrist_set(b, EMPTY, 7*8 + 0);
-            b->board[7*8 + 0] = EMPTY;
-            zobrist_set(b, (WHITE | ROOK | HAS_MOVED), 7*8 + 3);
-            b->board[7*8 + 3] = (WHITE | ROOK | HAS_MOVED);
+        if (piece_color(b->board[move_target(mv)]) == WHITE) {
+            set_square(b, EMPTY, 7*8 + 0);
+            set_square(b, (WHITE | ROOK | HAS_MOVED), 7*8 + 3);
         } else {
-            zobrist_set(b, EMPTY, 0);
-            b->board[0] = EMPTY;
-            zobrist_set(b, (BLACK | ROOK | HAS_MOVED), 3);
-            b->board[3] = (BLACK | ROOK | HAS_MOVED);
+            set_square(b, EMPTY, 0);
+            set_square(b, (BLACK | ROOK | HAS_MOVED), 3);
         }
         break;
     case SPECIAL_EN_PASSANT:
-        if (piece_color(b->board[mv.target]) == WHITE) {
-            gt.captured = b->board[mv.target + 8];
-            gt.capture_location = mv.target + 8;
-            zobrist_set(b, EMPTY, mv.target + 8);
-            b->board[mv.target + 8] = EMPTY;
+        if (piece_color(b->board[move_target(mv)]) == WHITE) {
+            gt.captured = b->board[move_target(mv) + 8];
+            gt.capture_location = move_target(mv) + 8;
+            set_square(b, EMPTY, move_target(mv) + 8);
         } else {
-            gt.captured = b->board[mv.target - 8];
-            gt.capture_location = mv.target - 8;
-            zobrist_set(b, EMPTY, mv.target - 8);
-            b->board[mv.target - 8] = EMPTY;
+            gt.captured = b->board[move_target(mv) - 8];
+            gt.capture_location = move_target(mv) - 8;
+            set_square(b, EMPTY, move_target(mv) - 8);
         }
         break;
     case SPECIAL_PROMOTE_QUEEN:
-        zobrist_set(b, (b->board[mv.target] & 0b11111000) | QUEEN, mv.target);
-        b->board[mv.target] = (b->board[mv.target] & 0b11111000) | QUEEN;
+        set_square(b, (b->board[move_target(mv)] & 0b11111000) | QUEEN, move_target(mv));
         break;
     case SPECIAL_PROMOTE_ROOK:
-        zobrist_set(b, (b->board[mv.target] & 0b11111000) | ROOK, mv.target);
-        b->board[mv.target] = (b->board[mv.target] & 0b11111000) | ROOK;
+        set_square(b, (b->board[move_target(mv)] & 0b11111000) | ROOK, move_target(mv));
         break;
     case SPECIAL_PROMOTE_BISHOP:
-        zobrist_set(b, (b->board[mv.target] & 0b11111000) | BISHOP, mv.target);
-        b->board[mv.target] = (b->board[mv.target] & 0b11111000) | BISHOP;
+        set_square(b, (b->board[move_target(mv)] & 0b11111000) | BISHOP, move_target(mv));
         break;
     case SPECIAL_PROMOTE_KNIGHT:
-        zobrist_set(b, (b->board[mv.target] & 0b11111000) | KNIGHT, mv.target);
-        b->board[mv.target] = (b->board[mv.target] & 0b11111000) | KNIGHT;
+        set_square(b, (b->board[move_target(mv)] & 0b11111000) | KNIGHT, move_target(mv));
         break;
     default:
         break;
     }
 
-    if (b->move_stack.at == NULL) {
-        da_init(&b->move_stack, 64);
-        da_clear(&b->move_stack);
-    }
-    // printf("%p %d %d\n", b->move_stack.at, b->move_stack.len, b->move_stack.cap);
-    da_append(&b->move_stack, gt);
+    b->en_passant = 0;
+    if (move_special(mv) == SPECIAL_PAWN_DOUBLE) b->en_passant = (move_start(mv) + move_target(mv)) / 2;
+
+    assert(b->move_stack_len < MAX_GAME_PLIES);
+    b->move_stack[b->move_stack_len++] = gt;
     if (swap_colors) swap_color_to_move(*b);
-    history_push(b, b->zobrist);
 }
 
 void undo_move(Board* b, bool swap_colors) {
-    if (b->move_stack.len == 0) return;
+    if (b->move_stack_len == 0) return;
 
-    if (swap_colors) swap_color_to_move(*b);
-    
-    history_pop(b);
+    // the hash gets put back from the tick at the end, so nothing here touches it
+    if (swap_colors) b->color_to_move = b->color_to_move == WHITE ? BLACK : WHITE;
 
-    // swap_color_to_move(*b);
-    GameTick gt = b->move_stack.at[b->move_stack.len - 1];
-    da_pop(&b->move_stack);
+    GameTick gt = b->move_stack[--b->move_stack_len];
 
     // if (print) printf("UNDO start %s target %s special %d captured %b captured_loc %s\n",
-    //     square_names[gt.move.start],
-    //     square_names[gt.move.target],
-    //     gt.move.special,
+    //     square_names[move_start(gt.move)],
+    //     square_names[move_target(gt.move)],
+    //     move_special(gt.move),
     //     gt.captured,
     //     square_names[gt.capture_location]);
 
-    // u8 start_piece  = b->board[gt.move.start];
-    u8 target_piece = b->board[gt.move.target];
+    // u8 start_piece  = b->board[move_start(gt.move)];
+    u8 target_piece = b->board[move_target(gt.move)];
 
-    zobrist_set(b, target_piece, gt.move.start);
-    b->board[gt.move.start] = target_piece;
-    zobrist_set(b, EMPTY, gt.move.target);
-    b->board[gt.move.target] = EMPTY;
+    set_square_unhashed(b, target_piece, move_start(gt.move));
+    set_square_unhashed(b, EMPTY, move_target(gt.move));
 
     if (gt.captured) {
-        zobrist_set(b, gt.captured, gt.capture_location);
-        b->board[gt.capture_location] = gt.captured;
+        set_square_unhashed(b, gt.captured, gt.capture_location);
     }
 
-    switch (gt.move.special) {
+    switch (move_special(gt.move)) {
     case SPECIAL_PROMOTE_BISHOP:
     case SPECIAL_PROMOTE_QUEEN:
     case SPECIAL_PROMOTE_KNIGHT:
     case SPECIAL_PROMOTE_ROOK:
-        zobrist_set(b, (b->board[gt.move.start] & 0b11111000) | PAWN, gt.move.start);
-        b->board[gt.move.start] = (b->board[gt.move.start] & 0b11111000) | PAWN;
+        set_square_unhashed(b, (b->board[move_start(gt.move)] & 0b11111000) | PAWN, move_start(gt.move));
         break;
     case SPECIAL_KINGSIDE_CASTLE:
         if (gt.white_move) {
-            zobrist_set(b, EMPTY, 7*8 + 5);
-            b->board[7*8 + 5] = EMPTY;
-            zobrist_set(b, WHITE | ROOK, 7*8 + 7);
-            b->board[7*8 + 7] = WHITE | ROOK;
+            set_square_unhashed(b, EMPTY, 7*8 + 5);
+            set_square_unhashed(b, WHITE | ROOK, 7*8 + 7);
         } else {
-            zobrist_set(b, EMPTY, 5);
-            b->board[5] = EMPTY;
-            zobrist_set(b, BLACK | ROOK, 7);
-            b->board[7] = BLACK | ROOK;
+            set_square_unhashed(b, EMPTY, 5);
+            set_square_unhashed(b, BLACK | ROOK, 7);
         }
         break;
     case SPECIAL_QUEENSIDE_CASTLE:
         if (gt.white_move) {
-            zobrist_set(b, EMPTY, 7*8 + 3);
-            b->board[7*8 + 3] = EMPTY;
-            zobrist_set(b, WHITE | ROOK, 7*8 + 0);
-            b->board[7*8 + 0] = WHITE | ROOK;
+            set_square_unhashed(b, EMPTY, 7*8 + 3);
+            set_square_unhashed(b, WHITE | ROOK, 7*8 + 0);
         } else {
-            zobrist_set(b, EMPTY, 3);
-            b->board[3] = EMPTY;
-            zobrist_set(b, BLACK | ROOK, 0);
-            b->board[0] = BLACK | ROOK;
+            set_square_unhashed(b, EMPTY, 3);
+            set_square_unhashed(b, BLACK | ROOK, 0);
         }
         break;
     
@@ -560,9 +754,38 @@ void undo_move(Board* b, bool swap_colors) {
     }
 
     if (gt.piece_first_move) {
-        zobrist_set(b, b->board[gt.move.start] & 0b11101111, gt.move.start);
-        b->board[gt.move.start] = b->board[gt.move.start] & 0b11101111;
+        set_square_unhashed(b, b->board[move_start(gt.move)] & 0b11101111, move_start(gt.move));
+    }
+
+    b->zobrist = gt.zobrist;
+    b->en_passant = gt.en_passant;
+}
+
+// long algebraic notation, like "e2e4" or "e7e8q". buf needs room for 6 chars.
+char* move_string(Move m, char* buf) {
+    char promotion = '\0';
+    switch (move_special(m)) {
+    case SPECIAL_PROMOTE_QUEEN:  promotion = 'q'; break;
+    case SPECIAL_PROMOTE_ROOK:   promotion = 'r'; break;
+    case SPECIAL_PROMOTE_BISHOP: promotion = 'b'; break;
+    case SPECIAL_PROMOTE_KNIGHT: promotion = 'n'; break;
+    }
+    sprintf(buf, "%s%s%c", square_names[move_start(m)], square_names[move_target(m)], promotion);
+    return buf;
+}
+
+// find the legal move written in long algebraic notation (e2e4, e7e8q, e1g1 for castling).
+// NULL_MOVE if there isnt one.
+Move parse_move(Board* b, char* text) {
+    MoveSet ms;
+    ms.len = 0;
+    legal_moves(b, &ms);
+
+    char buf[8];
+    foreach (Move m, ms) {
+        if (strcmp(move_string(m, buf), text) == 0) return m;
     }
+    return NULL_MOVE;
 }
 
 int indexof(char* s) {
@@ -0,0 +1,303 @@
+#include "chess.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// optional neural evaluator. a (768 -> hidden)x2 -> 1 network with a clipped relu,
+// the usual first net people train with bullet:
+//
+//   768 inputs per perspective: 384 for the perspective's own pieces, then 384 for the
+//   opponent's, each as 64 * (pawn knight bishop rook queen king) + square.
+//   squares count from a1 = 0 for white's perspective, black's is flipped vertically.
+//
+//   file layout, little endian i16s, no header:
+//     feature weights [768][hidden], feature bias [hidden],
+//     output weights [2][hidden] (side to move's half first), output bias.
+//   trainers usually pad the end out to 64 bytes, that is fine.
+//
+// the first layer is a running sum of the weights of every piece on the board.
+// the board keeps one per perspective and set_square adds and removes single pieces,
+// so only the small output layer runs per evaluation.
+
+#define NNUE_QA    255 // first layer quantization
+#define NNUE_QB    64  // output layer quantization
+#define NNUE_SCALE 400 // network output to centipawns
+
+typedef struct NnueNetwork {
+    int hidden;
+    i16* feature_weights;
+    i16* feature_bias;
+    i16* output_weights;
+    i16  output_bias;
+    void* data;
+} NnueNetwork;
+
+static NnueNetwork net = {};
+
+bool nnue_loaded = false;
+
+static const u8 nnue_piece_index[8] = {
+    [PAWN] = 0, [KNIGHT] = 1, [BISHOP] = 2, [ROOK] = 3, [QUEEN] = 4, [KING] = 5,
+};
+
+// board[] counts from a8 = 0, so white's perspective is the one that gets flipped here
+forceinline static int nnue_feature(u8 perspective, u8 piece, u8 square) {
+    int side = piece_color(piece) == perspective ? 0 : 384;
+    int rel_square = perspective == WHITE ? square ^ 56 : square;
+    return side + nnue_piece_index[piece_type(piece)] * 64 + rel_square;
+}
+
+// the kernels. hidden sizes are always a multiple of 16, so no tails to handle.
+
+static void vec_add(i16* acc, const i16* w, int len) {
+#if defined(__AVX2__)
+    for (int i = 0; i < len; i += 16) {
+        __m256i a = _mm256_loadu_si256((__m256i*)&acc[i]);
+        __m256i b = _mm256_loadu_si256((__m256i*)&w[i]);
+        _mm256_storeu_si256((__m256i*)&acc[i], _mm256_add_epi16(a, b));
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < len; i += 8) {
+        __m128i a = _mm_loadu_si128((__m128i*)&acc[i]);
+        __m128i b = _mm_loadu_si128((__m128i*)&w[i]);
+        _mm_storeu_si128((__m128i*)&acc[i], _mm_add_epi16(a, b));
+    }
+#else
+    for_range(i, 0, len) acc[i] += w[i];
+#endif
+}
+
+static void vec_sub(i16* acc, const i16* w, int len) {
+#if defined(__AVX2__)
+    for (int i = 0; i < len; i += 16) {
+        __m256i a = _mm256_loadu_si256((__m256i*)&acc[i]);
+        __m256i b = _mm256_loadu_si256((__m256i*)&w[i]);
+        _mm256_storeu_si256((__m256i*)&acc[i], _mm256_sub_epi16(a, b));
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < len; i += 8) {
+        __m128i a = _mm_loadu_si128((__m128i*)&acc[i]);
+        __m128i b = _mm_loadu_si128((__m128i*)&w[i]);
+        _mm_storeu_si128((__m128i*)&acc[i], _mm_sub_epi16(a, b));
+    }
+#else
+    for_range(i, 0, len) acc[i] -= w[i];
+#endif
+}
+
+// sum of clamp(acc, 0, QA) * w. each product fits in an i32 with plenty of room,
+// so madd's pairwise sums never overflow.
+static i32 crelu_dot(const i16* acc, const i16* w, int len) {
+#if defined(__AVX2__)
+    __m256i zero = _mm256_setzero_si256();
+    __m256i qa = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < len; i += 16) {
+        __m256i a = _mm256_loadu_si256((__m256i*)&acc[i]);
+        __m256i b = _mm256_loadu_si256((__m256i*)&w[i]);
+        a = _mm256_min_epi16(_mm256_max_epi16(a, zero), qa);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, b));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i qa = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < len; i += 8) {
+        __m128i a = _mm_loadu_si128((__m128i*)&acc[i]);
+        __m128i b = _mm_loadu_si128((__m128i*)&w[i]);
+        a = _mm_min_epi16(_mm_max_epi16(a, zero), qa);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a, b));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#else
+    i32 sum = 0;
+    for_range(i, 0, len) sum += (i32)min(max(acc[i], 0), NNUE_QA) * w[i];
+    return sum;
+#endif
+}
+
+// replaces whatever network was loaded before. returns false (and keeps the old one) on a bad file.
+bool nnue_load(char* path) {
+    fs_file file = {};
+    if (!fs_get(str(path), &file)) return false;
+
+    // everything is an i16, work the hidden size out from the file size
+    size_t per_neuron = sizeof(i16) * (NNUE_INPUTS + 1 + 2);
+    int hidden = (file.size - sizeof(i16)) / per_neuron;
+    size_t expected = per_neuron * hidden + sizeof(i16);
+    if (hidden <= 0 || hidden > NNUE_MAX_HIDDEN || hidden % 16 != 0 || file.size - expected >= 64) {
+        // stderr, stdout might belong to a protocol
+        fprintf(stderr, "nnue: %s is not a network this build can use\n", path);
+        fs_drop(&file);
+        return false;
+    }
+
+    void* data = aligned_alloc(64, (file.size + 63) & ~(size_t)63);
+    assert(data != NULL);
+    if (!fs_open(&file, "rb") || !fs_read_entire(&file, data)) {
+        free(data);
+        fs_drop(&file);
+        return false;
+    }
+    fs_drop(&file);
+
+    free(net.data);
+    net.data = data;
+    net.hidden = hidden;
+    net.feature_weights = data;
+    net.feature_bias    = net.feature_weights + NNUE_INPUTS * hidden;
+    net.output_weights  = net.feature_bias + hidden;
+    net.output_bias     = net.output_weights[2 * hidden];
+    nnue_loaded = true;
+    return true;
+}
+
+// start keeping the board's accumulators up to date. false if there is no network to do it with.
+bool nnue_enable(Board* b) {
+    b->nnue_enabled = nnue_loaded;
+    nnue_refresh(b);
+    return b->nnue_enabled;
+}
+
+// rebuild both accumulators from scratch
+void nnue_refresh(Board* b) {
+    if (!b->nnue_enabled) return;
+
+    for_range(p, 0, 2) {
+        i16* acc = b->nnue.values[p];
+        memcpy(acc, net.feature_bias, sizeof(i16) * net.hidden);
+        for_urange(i, 0, 64) {
+            u8 piece = b->board[i];
+            if (piece_type(piece) == EMPTY) continue;
+            vec_add(acc, &net.feature_weights[nnue_feature(p << 3, piece, i) * net.hidden], net.hidden);
+        }
+    }
+}
+
+void nnue_add_piece(Board* b, u8 piece, u8 square) {
+    vec_add(b->nnue.values[0], &net.feature_weights[nnue_feature(WHITE, piece, square) * net.hidden], net.hidden);
+    vec_add(b->nnue.values[1], &net.feature_weights[nnue_feature(BLACK, piece, square) * net.hidden], net.hidden);
+}
+
+void nnue_remove_piece(Board* b, u8 piece, u8 square) {
+    vec_sub(b->nnue.values[0], &net.feature_weights[nnue_feature(WHITE, piece, square) * net.hidden], net.hidden);
+    vec_sub(b->nnue.values[1], &net.feature_weights[nnue_feature(BLACK, piece, square) * net.hidden], net.hidden);
+}
+
+// centipawns, relative to the side to move
+int nnue_eval(Board* b) {
+    u8 us = b->color_to_move >> 3;
+    u8 them = us ^ 1;
+
+    i32 output = crelu_dot(b->nnue.values[us], net.output_weights, net.hidden) +
+                 crelu_dot(b->nnue.values[them], net.output_weights + net.hidden, net.hidden);
+    output += net.output_bias;
+    return (i64)output * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+}
+
+// self check for the kernels and the incremental updates. builds a random network,
+// plays random games with it and compares every accumulator and eval against a plain
+// scalar recomputation from scratch. exits nonzero on the first mismatch.
+
+#define NNUE_CHECK_HIDDEN 256
+#define NNUE_CHECK_GAMES  64
+#define NNUE_CHECK_PLIES  120
+
+static i16 random_weight(int range) {
+    return (i16)(genrand64_int64() % (2 * range + 1)) - range;
+}
+
+static void nnue_random_network(int hidden) {
+    size_t count = (size_t)(NNUE_INPUTS + 1 + 2) * hidden + 1;
+    i16* data = aligned_alloc(64, (count * sizeof(i16) + 63) & ~(size_t)63);
+    assert(data != NULL);
+
+    // small enough that 32 pieces never overflow an i16 accumulator
+    for_range(i, 0, NNUE_INPUTS * hidden) data[i] = random_weight(64);
+    for_range(i, NNUE_INPUTS * hidden, count) data[i] = random_weight(255);
+
+    free(net.data);
+    net.data = data;
+    net.hidden = hidden;
+    net.feature_weights = data;
+    net.feature_bias    = net.feature_weights + NNUE_INPUTS * hidden;
+    net.output_weights  = net.feature_bias + hidden;
+    net.output_bias     = net.output_weights[2 * hidden];
+    nnue_loaded = true;
+}
+
+// the same math as nnue_refresh and nnue_eval, one scalar loop at a time
+static int nnue_reference_eval(Board* b, i16 acc[2][NNUE_MAX_HIDDEN]) {
+    for_range(p, 0, 2) {
+        for_range(h, 0, net.hidden) {
+            i32 sum = net.feature_bias[h];
+            for_urange(i, 0, 64) {
+                u8 piece = b->board[i];
+                if (piece_type(piece) == EMPTY) continue;
+                sum += net.feature_weights[nnue_feature(p << 3, piece, i) * net.hidden + h];
+            }
+            acc[p][h] = sum;
+        }
+    }
+
+    u8 us = b->color_to_move >> 3;
+    i32 output = net.output_bias;
+    for_range(h, 0, net.hidden) {
+        output += (i32)min(max(acc[us][h], 0), NNUE_QA) * net.output_weights[h];
+        output += (i32)min(max(acc[us ^ 1][h], 0), NNUE_QA) * net.output_weights[net.hidden + h];
+    }
+    return (i64)output * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+}
+
+static bool nnue_check_position(Board* b) {
+    i16 acc[2][NNUE_MAX_HIDDEN];
+    int expected = nnue_reference_eval(b, acc);
+    int got = nnue_eval(b);
+
+    bool ok = got == expected;
+    for_range(p, 0, 2) {
+        if (memcmp(acc[p], b->nnue.values[p], sizeof(i16) * net.hidden) != 0) ok = false;
+    }
+    if (!ok) {
+        printf("nnue check failed after %u plies: eval %d, expected %d\n", b->move_stack_len, got, expected);
+        print_board(b, NULL);
+    }
+    return ok;
+}
+
+int nnue_check_main(int argc, char** argv) {
+    init_genrand64(0x6E6E7565ull);
+    nnue_random_network(NNUE_CHECK_HIDDEN);
+
+    u64 positions = 0;
+    for_range(game, 0, NNUE_CHECK_GAMES) {
+        Board b = {};
+        init_board(&b);
+        nnue_enable(&b);
+
+        // play forward checking every position, then undo the whole game checking again
+        for_range(ply, 0, NNUE_CHECK_PLIES) {
+            MoveSet moves;
+            moves.len = 0;
+            if (legal_moves(&b, &moves) == 0) break;
+            make_move(&b, moves.at[genrand64_int64() % moves.len], true);
+            positions++;
+            if (!nnue_check_position(&b)) return EXIT_FAILURE;
+        }
+        while (b.move_stack_len != 0) {
+            undo_move(&b, true);
+            positions++;
+            if (!nnue_check_position(&b)) return EXIT_FAILURE;
+        }
+    }
+
+    printf("nnue check: %llu positions match the scalar reference\n", positions);
+    return EXIT_SUCCESS;
+}
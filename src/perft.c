@@ -0,0 +1,293 @@
+#include "chess.h"
+#include <pthread.h>
+
+// perft - count every leaf of the legal move tree to a fixed depth.
+// the counts for these positions are well known, so any mismatch is a move generation bug.
+
+#define PERFT_MAX_DEPTH 6
+
+typedef struct PerftPosition {
+    char* name;
+    char* fen;
+    u64 nodes[PERFT_MAX_DEPTH]; // nodes[d-1] is the count at depth d, 0 if unknown
+} PerftPosition;
+
+static PerftPosition perft_suite[] = {
+    {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+        {20, 400, 8902, 197281, 4865609, 119060324}},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+        {48, 2039, 97862, 4085603, 193690690, 8031647685}},
+    {"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+        {14, 191, 2812, 43238, 674624, 11030083}},
+    {"position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq -",
+        {6, 264, 9467, 422333, 15833292, 706045033}},
+    {"position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ -",
+        {44, 1486, 62379, 2103487, 89941194, 0}},
+    {"position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - -",
+        {46, 2079, 89890, 3894594, 164075551, 6923051137}},
+    {"en passant check", "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3",
+        {15, 126, 1928, 13931, 206379, 1440467}},
+};
+
+static u64 milliseconds_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000 + (u64)ts.tv_nsec / 1000000;
+}
+
+u64 perft(Board* b, int depth) {
+    if (depth <= 0) return 1;
+    // bulk counting, the last ply doesnt need to be played out
+    if (depth == 1) return legal_moves(b, NULL);
+
+    MoveSet ms;
+    ms.len = 0;
+    legal_moves(b, &ms);
+
+    u64 nodes = 0;
+    foreach (Move m, ms) {
+        make_move(b, m, true);
+        nodes += perft(b, depth - 1);
+        undo_move(b, true);
+    }
+    return nodes;
+}
+
+// perft, but report the subtree size under each root move
+u64 perft_divide(Board* b, int depth) {
+    if (depth <= 0) return 1;
+
+    MoveSet ms;
+    ms.len = 0;
+    legal_moves(b, &ms);
+
+    u64 nodes = 0;
+    char buf[8];
+    foreach (Move m, ms) {
+        make_move(b, m, true);
+        u64 subtree = perft(b, depth - 1);
+        undo_move(b, true);
+
+        printf("  %-5s %llu\n", move_string(m, buf), subtree);
+        nodes += subtree;
+    }
+    printf("  %d moves\n", (int)ms.len);
+    return nodes;
+}
+
+// multithreaded perft.
+// root moves are handed out to a pool of threads, each with its own copy of the board.
+// subtree counts are shared between threads through a lockless hash: every slot stores
+// its key xor'd with its data, so a slot torn by two threads writing at once just misses.
+
+typedef struct PerftSlot {
+    _Atomic u64 key;  // zobrist ^ data
+    _Atomic u64 data; // nodes << 8 | depth
+} PerftSlot;
+
+typedef struct PerftHash {
+    PerftSlot* at;
+    u64 len;
+} PerftHash;
+
+typedef struct PerftJob {
+    Board* root;
+    int depth;
+    PerftHash* hash;
+
+    Move* moves;
+    u64* subtrees;
+    int num_moves;
+    _Atomic int next_move;
+} PerftJob;
+
+// the zobrist hash doesnt know about en passant, perft does
+static u64 perft_key(Board* b) {
+    u64 key = b->zobrist;
+    key ^= b->en_passant * 0x9E3779B97F4A7C15ull;
+    return key;
+}
+
+static u64 perft_hashed(Board* b, int depth, PerftHash* hash) {
+    if (depth == 1) return legal_moves(b, NULL);
+
+    u64 key = perft_key(b);
+    PerftSlot* slot = &hash->at[key % hash->len];
+    u64 slot_key  = atomic_load_explicit(&slot->key, memory_order_relaxed);
+    u64 slot_data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    if ((slot_key ^ slot_data) == key && (slot_data & 0xFF) == depth) {
+        return slot_data >> 8;
+    }
+
+    MoveSet ms;
+    ms.len = 0;
+    legal_moves(b, &ms);
+
+    u64 nodes = 0;
+    foreach (Move m, ms) {
+        make_move(b, m, true);
+        nodes += perft_hashed(b, depth - 1, hash);
+        undo_move(b, true);
+    }
+
+    u64 data = nodes << 8 | depth;
+    atomic_store_explicit(&slot->key, key ^ data, memory_order_relaxed);
+    atomic_store_explicit(&slot->data, data, memory_order_relaxed);
+    return nodes;
+}
+
+static void* perft_worker(void* arg) {
+    PerftJob* job = arg;
+
+    Board b = {};
+    copy_board(&b, job->root);
+
+    while (true) {
+        int i = atomic_fetch_add(&job->next_move, 1);
+        if (i >= job->num_moves) break;
+
+        make_move(&b, job->moves[i], true);
+        job->subtrees[i] = job->depth == 1 ? 1 : perft_hashed(&b, job->depth - 1, job->hash);
+        undo_move(&b, true);
+    }
+
+    destroy_board(&b);
+    return NULL;
+}
+
+u64 perft_parallel(Board* b, int depth, int threads, u64 hash_mb, bool divide) {
+    if (depth <= 0) return 1;
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    MoveSet ms;
+    ms.len = 0;
+    legal_moves(b, &ms);
+
+    PerftHash hash = {};
+    hash.len = max(hash_mb * 1024 * 1024 / sizeof(PerftSlot), 1);
+    hash.at = calloc(hash.len, sizeof(PerftSlot));
+    assert(hash.at != NULL);
+
+    PerftJob job = {
+        .root = b,
+        .depth = depth,
+        .hash = &hash,
+        .moves = ms.at,
+        .subtrees = calloc(ms.len + 1, sizeof(u64)),
+        .num_moves = ms.len,
+    };
+
+    pthread_t* pool = malloc(sizeof(pthread_t) * threads);
+    for_range(i, 0, threads) pthread_create(&pool[i], NULL, perft_worker, &job);
+    for_range(i, 0, threads) pthread_join(pool[i], NULL);
+
+    u64 nodes = 0;
+    char buf[8];
+    for_range(i, 0, ms.len) {
+        if (divide) printf("  %-5s %llu\n", move_string(ms.at[i], buf), job.subtrees[i]);
+        nodes += job.subtrees[i];
+    }
+    if (divide) printf("  %d moves\n", (int)ms.len);
+
+    free(pool);
+    free(job.subtrees);
+    free(hash.at);
+    return nodes;
+}
+
+static void print_nodes(char* name, int depth, u64 nodes, u64 milliseconds) {
+    u64 nps = nodes * 1000 / max(milliseconds, 1);
+    printf("%-16s depth %d  %12llu nodes  %6llu ms  %10llu nps", name, depth, nodes, milliseconds, nps);
+}
+
+// run the whole suite up to some depth. returns the number of mismatches.
+// with more than one thread, the parallel driver and its hash get used instead.
+int perft_suite_run(int depth, int threads, u64 hash_mb) {
+    int failures = 0;
+    u64 total_nodes = 0;
+    u64 total_milliseconds = 0;
+
+    Board b = {};
+    init_board(&b);
+
+    for_range(i, 0, sizeof(perft_suite) / sizeof(perft_suite[0])) {
+        PerftPosition* p = &perft_suite[i];
+
+        // run each position as deep as we have a known count for
+        int d = min(depth, PERFT_MAX_DEPTH);
+        while (d > 1 && p->nodes[d - 1] == 0) d--;
+
+        load_board(&b, p->fen);
+        u64 start = milliseconds_now();
+        u64 nodes = threads == 1 ? perft(&b, d) : perft_parallel(&b, d, threads, hash_mb, false);
+        u64 elapsed = milliseconds_now() - start;
+
+        total_nodes += nodes;
+        total_milliseconds += elapsed;
+
+        print_nodes(p->name, d, nodes, elapsed);
+        if (nodes == p->nodes[d - 1]) {
+            printf("  ok\n");
+        } else {
+            printf("  FAILED, expected %llu\n", p->nodes[d - 1]);
+            perft_divide(&b, d);
+            failures++;
+        }
+    }
+
+    print_nodes("total", depth, total_nodes, total_milliseconds);
+    printf("\n%d/%d positions passed\n", (int)(sizeof(perft_suite) / sizeof(perft_suite[0])) - failures, (int)(sizeof(perft_suite) / sizeof(perft_suite[0])));
+    return failures;
+}
+
+static bool is_number(char* s) {
+    if (*s == '\0') return false;
+    for (; *s != '\0'; s++) {
+        if (*s < '0' || *s > '9') return false;
+    }
+    return true;
+}
+
+// chess perft [depth] [fen] [-t threads] [-m hash megabytes]
+// without a fen, runs the suite and exits non-zero if any count is wrong.
+// -t 0 uses one thread per core.
+int perft_main(int argc, char** argv) {
+    int depth = 4;
+    int threads = 1;
+    u64 hash_mb = 64;
+    char* fen = NULL;
+
+    bool have_depth = false;
+    for_range(i, 0, argc) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            hash_mb = atoi(argv[++i]);
+            if (hash_mb == 0) hash_mb = 1;
+        } else if (!have_depth && is_number(argv[i])) {
+            // a fen is never all digits, so a number is the depth wherever it is
+            depth = atoi(argv[i]);
+            have_depth = true;
+        } else {
+            fen = argv[i];
+        }
+    }
+    if (depth <= 0) depth = 4;
+
+    if (fen == NULL) {
+        return perft_suite_run(depth, threads, hash_mb) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Board b = {};
+    init_board(&b);
+    load_board(&b, fen);
+
+    u64 start = milliseconds_now();
+    u64 nodes = threads == 1 ? perft_divide(&b, depth) : perft_parallel(&b, depth, threads, hash_mb, true);
+    u64 elapsed = milliseconds_now() - start;
+
+    print_nodes("perft", depth, nodes, elapsed);
+    printf("\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,25 @@
+#include "chess.h"
+
+// every player the front-ends can pick by name
+
+const Player* const all_players[] = {
+    &player_random,
+    &player_first,
+    &player_user,
+    &player_v1,
+    &player_v2,
+    &player_v3,
+    &player_v4,
+    &player_v5,
+    &player_v6,
+    &player_v7,
+    &player_v8,
+    NULL,
+};
+
+const Player* find_player(char* name) {
+    for (int i = 0; all_players[i] != NULL; i++) {
+        if (strcmp(all_players[i]->name, name) == 0) return all_players[i];
+    }
+    return NULL;
+}
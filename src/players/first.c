@@ -1,27 +1,35 @@
 #include "chess.h"
 
-static int eval(Board* b) {
+typedef struct Context {
+    MoveSet ms;
+} Context;
+
+static int eval(void* ctx, Board* b) {
     return 0;
 }
 
-static MoveSet ms = {};
-
-static Move select_move(Board* b, int* eval_out) {
-    da_clear(&ms);
-    int num_moves = legal_moves(b, &ms);
+static Move select_move(void* ctx, Board* b, int* eval_out) {
+    Context* context = ctx;
+    context->ms.len = 0;
+    int num_moves = legal_moves(b, &context->ms);
     if (num_moves == 0) {
         return NULL_MOVE;
     }
-    return ms.at[0];
+    return context->ms.at[0];
+}
+
+static void* init() {
+    return calloc(1, sizeof(Context));
 }
 
-static void init() {
-    if (ms.at == NULL) da_init(&ms, 64);
+static void destroy(void* ctx) {
+    free(ctx);
 }
 
 const Player player_first = {
     .name = "first",
     .init = init,
+    .destroy = destroy,
     .eval = eval,
     .select = select_move,
 };
\ No newline at end of file
@@ -1,35 +1,46 @@
 #include "chess.h"
 
-static int eval(Board* b) {
+typedef struct Context {
+    MoveSet ms;
+    unsigned int seed; // rand() is shared by the whole process, each instance gets its own sequence
+} Context;
+
+static int eval(void* ctx, Board* b) {
     return 0;
 }
 
-static MoveSet ms = {};
-
-static Move select_move(Board* b, int* eval_out) {
-    da_clear(&ms);
+static Move select_move(void* ctx, Board* b, int* eval_out) {
+    Context* context = ctx;
+    context->ms.len = 0;
 
-    int num_moves = legal_moves(b, &ms);
+    int num_moves = legal_moves(b, &context->ms);
     if (num_moves == 0) {
         return NULL_MOVE;
     }
     if (num_moves == 1) {
-        return ms.at[0];
+        return context->ms.at[0];
     }
-    return ms.at[rand() % num_moves];
+    return context->ms.at[rand_r(&context->seed) % num_moves];
 }
 
-static void init() {
+static void* init() {
+    Context* context = calloc(1, sizeof(Context));
+
     struct timeval time = {};
     gettimeofday(&time, NULL);
-    srand((int)time.tv_usec);
+    context->seed = (unsigned int)time.tv_usec ^ (unsigned int)(uintptr_t)context;
+
+    return context;
+}
 
-    if (ms.at == NULL) da_init(&ms, 64);
+static void destroy(void* ctx) {
+    free(ctx);
 }
 
 const Player player_random = {
     .name = "random",
     .init = init,
+    .destroy = destroy,
     .eval = eval,
     .select = select_move,
 };
\ No newline at end of file
@@ -1,34 +1,38 @@
 #include "chess.h"
 
-static int eval(Board* b) {
+typedef struct Context {
+    MoveSet ms;
+} Context;
+
+static int eval(void* ctx, Board* b) {
     return 0;
 }
 
 void print_board_w_moveset_w_start_square(Board* b, MoveSet* ms, u8 starting_square) {
     u8 highlights[64] = {};
     foreach (Move m, *ms) {
-        if (m.start != starting_square) {
+        if (move_start(m) != starting_square) {
             continue;
         }
-        highlights[m.target] += 1;
+        highlights[move_target(m)] += 1;
     }
     print_board(b, highlights);
 }
 
-static Move select_move(Board* b, int* eval_out) {
-    static MoveSet ms = {};
-    if (ms.at == NULL) da_init(&ms, 32);
-    da_clear(&ms);
+static Move select_move(void* ctx, Board* b, int* eval_out) {
+    Context* context = ctx;
+    MoveSet* ms = &context->ms;
+    ms->len = 0;
 
-    legal_moves(b, &ms);
-    if (ms.len == 0) {
+    legal_moves(b, ms);
+    if (ms->len == 0) {
         return NULL_MOVE;
     }
     printf("\n");
 
     start_again:
 
-    print_board_w_moveset(b, &ms);
+    print_board_w_moveset(b, ms);
 
     char input_buf[100] = {};
 
@@ -45,8 +49,8 @@ static Move select_move(Board* b, int* eval_out) {
             start_index = -1;
         } else {
             bool is_valid_move_start = false;
-            foreach (Move m, ms) {
-                if (m.start == start_index) is_valid_move_start = true;
+            foreach (Move m, *ms) {
+                if (move_start(m) == start_index) is_valid_move_start = true;
             }
             if (!is_valid_move_start) start_index = -1;
         }
@@ -56,7 +60,7 @@ static Move select_move(Board* b, int* eval_out) {
             continue;
         }
 
-        print_board_w_moveset_w_start_square(b, &ms, start_index);
+        print_board_w_moveset_w_start_square(b, ms, start_index);
         break;
     }
 
@@ -76,8 +80,8 @@ static Move select_move(Board* b, int* eval_out) {
             target_index = -1;
         } else {
             bool is_valid_move_start = false;
-            foreach (Move m, ms) {
-                if (m.start == start_index && m.target == target_index) is_valid_move_start = true;
+            foreach (Move m, *ms) {
+                if (move_start(m) == start_index && move_target(m) == target_index) is_valid_move_start = true;
             }
             if (!is_valid_move_start) target_index = -1;
         }
@@ -89,8 +93,8 @@ static Move select_move(Board* b, int* eval_out) {
         break;
     }
 
-    foreach (Move m, ms) {
-        if (m.start == start_index && m.target == target_index) {
+    foreach (Move m, *ms) {
+        if (move_start(m) == start_index && move_target(m) == target_index) {
             return m;
         }
     }
@@ -99,13 +103,18 @@ static Move select_move(Board* b, int* eval_out) {
     return NULL_MOVE;
 }
 
-static void init() {
+static void* init() {
+    return calloc(1, sizeof(Context));
+}
 
+static void destroy(void* ctx) {
+    free(ctx);
 }
 
 const Player player_user = {
     .name = "user",
     .init = init,
+    .destroy = destroy,
     .eval = eval,
     .select = select_move,
 };
\ No newline at end of file
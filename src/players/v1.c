@@ -2,28 +2,20 @@
 
 // v1 - evaluate the board after every possible move and choose the move that gives the best evaluation
 
-static int eval(Board* b) {
-    int diff_pawns = 0;
-    int diff_rooks = 0;
-    int diff_knights = 0;
-    int diff_bishops = 0;
-    int diff_queens = 0;
-    int diff_kings = 0;
-
-    for_range(i, 0, 64) {
-        u8 p = b->board[i];
-        int offset = piece_color(p) == b->color_to_move ? 1 : -1;
-        switch (piece_type(p)) {
-        case PAWN:   diff_pawns   += offset; break;
-        case ROOK:   diff_rooks   += offset; break;
-        case KNIGHT: diff_knights += offset; break;
-        case BISHOP: diff_bishops += offset; break;
-        case QUEEN:  diff_queens  += offset; break;
-        case KING:   diff_kings   += offset; break;
-        default:
-            break;
-        }
-    }
+typedef struct Context {
+    MoveSet ms;
+} Context;
+
+static int eval(void* ctx, Board* b) {
+    u8 us = b->color_to_move;
+    u8 them = us ^ BLACK;
+
+    int diff_pawns   = popcount(pieces(b, us, PAWN))   - popcount(pieces(b, them, PAWN));
+    int diff_rooks   = popcount(pieces(b, us, ROOK))   - popcount(pieces(b, them, ROOK));
+    int diff_knights = popcount(pieces(b, us, KNIGHT)) - popcount(pieces(b, them, KNIGHT));
+    int diff_bishops = popcount(pieces(b, us, BISHOP)) - popcount(pieces(b, them, BISHOP));
+    int diff_queens  = popcount(pieces(b, us, QUEEN))  - popcount(pieces(b, them, QUEEN));
+    int diff_kings   = popcount(pieces(b, us, KING))   - popcount(pieces(b, them, KING));
 
     int diff_mobility = pseudo_legal_moves(b, NULL, false);
     swap_color_to_move(*b);
@@ -39,27 +31,27 @@ static int eval(Board* b) {
         1*(diff_mobility);
 }
 
-static MoveSet ms = {};
-
-static Move select_move(Board* b, int* eval_out) {
-    da_clear(&ms);
-    int num_moves = legal_moves(b, &ms);
+static Move select_move(void* ctx, Board* b, int* eval_out) {
+    Context* context = ctx;
+    MoveSet* ms = &context->ms;
+    ms->len = 0;
+    int num_moves = legal_moves(b, ms);
     if (num_moves == 0) {
         return NULL_MOVE;
     }
 
     // printf("color %s\n", b->color_to_move == WHITE ? "white" : "black");
     
-    Move best = ms.at[0];
+    Move best = ms->at[0];
     make_move(b, best, false);
-    int best_eval = eval(b);
+    int best_eval = eval(context, b);
     undo_move(b, false);
 
-    for_range(i, 1, ms.len) {
-        Move m = ms.at[i];
+    for_range(i, 1, ms->len) {
+        Move m = ms->at[i];
 
         make_move(b, m, false);
-        int m_eval = eval(b);
+        int m_eval = eval(context, b);
         undo_move(b, false);
 
         if (m_eval > best_eval) {
@@ -73,13 +65,18 @@ static Move select_move(Board* b, int* eval_out) {
     return best;
 }
 
-static void init() {
-    if (ms.at == NULL) da_init(&ms, 64);
+static void* init() {
+    return calloc(1, sizeof(Context));
+}
+
+static void destroy(void* ctx) {
+    free(ctx);
 }
 
 const Player player_v1 = {
     .name = "v1",
     .init = init,
+    .destroy = destroy,
     .eval = eval,
     .select = select_move,
 };
\ No newline at end of file
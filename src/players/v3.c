@@ -2,6 +2,12 @@
 
 #define SEARCH_DEPTH 4
 
+typedef struct Search {
+    Move best_move;
+    int  best_eval;
+    MoveSet movesets[SEARCH_DEPTH + 1]; // one per depth
+} Search;
+
 static forceinline int piece_value(u8 kind) {
     switch (kind) {
     case KING: return 2000;
@@ -14,28 +20,16 @@ static forceinline int piece_value(u8 kind) {
     return 0;
 };
 
-static int eval(Board* b) {
-    int diff_pawns = 0;
-    int diff_rooks = 0;
-    int diff_knights = 0;
-    int diff_bishops = 0;
-    int diff_queens = 0;
-    int diff_kings = 0;
-
-    for_range(i, 0, 64) {
-        u8 p = b->board[i];
-        int offset = piece_color(p) == b->color_to_move ? 1 : -1;
-        switch (piece_type(p)) {
-        case PAWN:   diff_pawns   += offset; break;
-        case ROOK:   diff_rooks   += offset; break;
-        case KNIGHT: diff_knights += offset; break;
-        case BISHOP: diff_bishops += offset; break;
-        case QUEEN:  diff_queens  += offset; break;
-        case KING:   diff_kings   += offset; break;
-        default:
-            break;
-        }
-    }
+static int eval(void* ctx, Board* b) {
+    u8 us = b->color_to_move;
+    u8 them = us ^ BLACK;
+
+    int diff_pawns   = popcount(pieces(b, us, PAWN))   - popcount(pieces(b, them, PAWN));
+    int diff_rooks   = popcount(pieces(b, us, ROOK))   - popcount(pieces(b, them, ROOK));
+    int diff_knights = popcount(pieces(b, us, KNIGHT)) - popcount(pieces(b, them, KNIGHT));
+    int diff_bishops = popcount(pieces(b, us, BISHOP)) - popcount(pieces(b, them, BISHOP));
+    int diff_queens  = popcount(pieces(b, us, QUEEN))  - popcount(pieces(b, them, QUEEN));
+    int diff_kings   = popcount(pieces(b, us, KING))   - popcount(pieces(b, them, KING));
 
     int diff_mobility = pseudo_legal_moves(b, NULL, false);
     swap_color_to_move(*b);
@@ -60,12 +54,12 @@ static void order_moves(Board* b, MoveSet* ms) {
         Move m = ms->at[i];
 
         int score = 0;
-        u8 moved_type = piece_type(b->board[m.start]);
-        u8 captured_type = piece_type(b->board[m.target]);
+        u8 moved_type = piece_type(b->board[move_start(m)]);
+        u8 captured_type = piece_type(b->board[move_target(m)]);
 
         if (captured_type != EMPTY) score += piece_value(captured_type) - piece_value(moved_type);
 
-        if (moved_type == PAWN) switch (m.special) {
+        if (moved_type == PAWN) switch (move_special(m)) {
         case SPECIAL_PROMOTE_QUEEN:  score += piece_value(QUEEN); break;
         case SPECIAL_PROMOTE_KNIGHT: score += piece_value(KNIGHT); break;
         case SPECIAL_PROMOTE_ROOK:   score += piece_value(ROOK); break;
@@ -88,13 +82,13 @@ static void order_moves(Board* b, MoveSet* ms) {
     }
 }
 
-static int q_search(Board* b, int alpha, int beta) {
-    int evaluation = eval(b);
+static int q_search(Search* s, Board* b, int alpha, int beta) {
+    int evaluation = eval(s, b);
     if (evaluation >= beta) return beta;
     alpha = max(alpha, evaluation);
 
-    MoveSet ms = {};
-    da_init(&ms, 80);
+    MoveSet ms;
+    ms.len = 0;
 
     legal_captures(b, &ms);
     order_moves(b, &ms);
@@ -102,33 +96,26 @@ static int q_search(Board* b, int alpha, int beta) {
         Move m = ms.at[i];
 
         make_move(b, m, true);
-        evaluation = -q_search(b, -beta, -alpha);
+        evaluation = -q_search(s, b, -beta, -alpha);
         undo_move(b, true);
 
         if (evaluation >= beta) return beta;
         alpha = max(alpha, evaluation);
     }
 
-    da_destroy(&ms);
-
     return alpha;
 }
 
-static Move best_move;
-static int  best_eval;
-
-static int search(Board* b, int depth, int alpha, int beta) {
+static int search(Search* s, Board* b, int depth, int alpha, int beta) {
     // printf("V2 depth %d\n", depth);
     // print_board(b, NULL);    
     
     if (depth == 0) {
-        return q_search(b, alpha, beta);
+        return q_search(s, b, alpha, beta);
     }
 
-    static MoveSet movesets[SEARCH_DEPTH + 1] = {};
-    MoveSet* ms = &movesets[depth];
-    if (ms->at == NULL) da_init(ms, 64);
-    da_clear(ms);
+    MoveSet* ms = &s->movesets[depth];
+    ms->len = 0;
 
     legal_moves(b, ms);
 
@@ -139,7 +126,7 @@ static int search(Board* b, int depth, int alpha, int beta) {
         pseudo_legal_moves(b, ms, true);
         swap_color_to_move(*b);
         foreach (Move m, *ms) {
-            if (piece_type(b->board[m.target]) == KING) {
+            if (piece_type(b->board[move_target(m)]) == KING) {
                 in_check = true;
                 break;
             }
@@ -156,7 +143,7 @@ static int search(Board* b, int depth, int alpha, int beta) {
 
     foreach (Move m, *ms) {
         make_move(b, m, true);
-        int evaluation = -search(b, depth - 1, -beta, -alpha);
+        int evaluation = -search(s, b, depth - 1, -beta, -alpha);
         undo_move(b, true);
 
         if (evaluation >= beta) {
@@ -169,33 +156,39 @@ static int search(Board* b, int depth, int alpha, int beta) {
 
             if (depth == SEARCH_DEPTH) {
                 // printf("select move %s -> %s\n",
-                    // square_names[m.start],
-                    // square_names[m.target]);
-                best_move = m;
-                best_eval = evaluation;
+                    // square_names[move_start(m)],
+                    // square_names[move_target(m)]);
+                s->best_move = m;
+                s->best_eval = evaluation;
             }
         }
     }
     return alpha;
 }
 
-static Move select_move(Board* b, int* eval_out) {
+static Move select_move(void* ctx, Board* b, int* eval_out) {
+    Search* s = ctx;
 
-    best_eval = 0;
-    best_move = NULL_MOVE;
+    s->best_eval = 0;
+    s->best_move = NULL_MOVE;
 
-    *eval_out = search(b, SEARCH_DEPTH, -200000, 200000);
+    *eval_out = search(s, b, SEARCH_DEPTH, -200000, 200000);
 
-    return best_move;
+    return s->best_move;
 }
 
-static void init() {
+static void* init() {
+    return calloc(1, sizeof(Search));
+}
 
+static void destroy(void* ctx) {
+    free(ctx);
 }
 
 const Player player_v3 = {
     .name = "v3",
     .init = init,
+    .destroy = destroy,
     .eval = eval,
     .select = select_move,
 };
\ No newline at end of file
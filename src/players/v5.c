@@ -1,11 +1,13 @@
 #include "chess.h"
 
-#define SEARCH_BUFFER_LEN 256
-#define QSEARCH_BUFFER_LEN 256
-
 // #define FUCKING_HATE_STALEMATES
 
-static TransposTable tt = {};
+typedef struct Search {
+    TransposTable tt;
+    Move best_move;
+    int  best_eval;
+    int  search_depth;
+} Search;
 
 static int piece_value(u8 kind) {
     switch (kind) {
@@ -19,28 +21,16 @@ static int piece_value(u8 kind) {
     return 0;
 };
 
-static int eval(Board* b) {
-    int diff_pawns = 0;
-    int diff_rooks = 0;
-    int diff_knights = 0;
-    int diff_bishops = 0;
-    int diff_queens = 0;
-    int diff_kings = 0;
-
-    for_range(i, 0, 64) {
-        u8 p = b->board[i];
-        int offset = piece_color(p) == b->color_to_move ? 1 : -1;
-        switch (piece_type(p)) {
-        case PAWN:   diff_pawns   += offset; break;
-        case ROOK:   diff_rooks   += offset; break;
-        case KNIGHT: diff_knights += offset; break;
-        case BISHOP: diff_bishops += offset; break;
-        case QUEEN:  diff_queens  += offset; break;
-        case KING:   diff_kings   += offset; break;
-        default:
-            break;
-        }
-    }
+static int eval(void* ctx, Board* b) {
+    u8 us = b->color_to_move;
+    u8 them = us ^ BLACK;
+
+    int diff_pawns   = popcount(pieces(b, us, PAWN))   - popcount(pieces(b, them, PAWN));
+    int diff_rooks   = popcount(pieces(b, us, ROOK))   - popcount(pieces(b, them, ROOK));
+    int diff_knights = popcount(pieces(b, us, KNIGHT)) - popcount(pieces(b, them, KNIGHT));
+    int diff_bishops = popcount(pieces(b, us, BISHOP)) - popcount(pieces(b, them, BISHOP));
+    int diff_queens  = popcount(pieces(b, us, QUEEN))  - popcount(pieces(b, them, QUEEN));
+    int diff_kings   = popcount(pieces(b, us, KING))   - popcount(pieces(b, them, KING));
 
     int diff_mobility = pseudo_legal_moves(b, NULL, false);
     swap_color_to_move(*b);
@@ -64,12 +54,12 @@ static void order_moves(Board* b, MoveSet* ms) {
         Move m = ms->at[i];
 
         int score = 0;
-        u8 moved_type = piece_type(b->board[m.start]);
-        u8 captured_type = piece_type(b->board[m.target]);
+        u8 moved_type = piece_type(b->board[move_start(m)]);
+        u8 captured_type = piece_type(b->board[move_target(m)]);
 
         if (captured_type != EMPTY) score += piece_value(captured_type) - piece_value(moved_type);
 
-        if (moved_type == PAWN) switch (m.special) {
+        if (moved_type == PAWN) switch (move_special(m)) {
         case SPECIAL_PROMOTE_QUEEN:  score += piece_value(QUEEN); break;
         case SPECIAL_PROMOTE_KNIGHT: score += piece_value(KNIGHT); break;
         case SPECIAL_PROMOTE_ROOK:   score += piece_value(ROOK); break;
@@ -92,19 +82,12 @@ static void order_moves(Board* b, MoveSet* ms) {
     }
 }
 
-static int q_search(Board* b, int alpha, int beta) {
-    int evaluation = eval(b);
+static int q_search(Search* s, Board* b, int alpha, int beta) {
+    int evaluation = eval(s, b);
     if (evaluation >= beta) return beta;
     alpha = max(alpha, evaluation);
 
-    MoveSet ms = {};
-    // da_init(&ms, 80);
-
-    // RISKY BUSINESS FOR SURE
-    // BAD SANDWICH BAD SANDWICH BAD SANDWICH
-    Move backing_buffer[128];
-    ms.at = backing_buffer;
-    ms.cap = 128;
+    MoveSet ms;
     ms.len = 0;
 
     legal_captures(b, &ms);
@@ -113,28 +96,23 @@ static int q_search(Board* b, int alpha, int beta) {
         Move m = ms.at[i];
 
         make_move(b, m, true);
-        evaluation = -q_search(b, -beta, -alpha);
+        evaluation = -q_search(s, b, -beta, -alpha);
         undo_move(b, true);
 
         if (evaluation >= beta) return beta;
         alpha = max(alpha, evaluation);
     }
 
-    // da_destroy(&ms);
     return alpha;
 }
 
-static Move best_move;
-static int  best_eval;
-static int  search_depth;
-
-static int search(Board* b, int depth, int alpha, int beta) {
+static int search(Search* s, Board* b, int depth, int alpha, int beta) {
     
     if (depth == 0) { // bottom
-        return q_search(b, alpha, beta);
+        return q_search(s, b, alpha, beta);
     }
 
-    if (depth < search_depth) {
+    if (depth < s->search_depth) {
         // avoid stalemate by repetition
         if (history_contains(b, b->zobrist)) {
 #ifdef FUCKING_HATE_STALEMATES
@@ -145,18 +123,13 @@ static int search(Board* b, int depth, int alpha, int beta) {
         }
     }
 
-    TransposEntry* entry = ttable_get(&tt, b->zobrist, depth, alpha, beta);
-    if (entry != NULL && depth != search_depth) return entry->eval; // dont accept stored evaluations on the root
+    TransposEntry* entry = ttable_get(&s->tt, b->zobrist, depth, alpha, beta);
+    if (entry != NULL && depth != s->search_depth) return entry->eval; // dont accept stored evaluations on the root
 
 
     u8 bound = TT_UPPER;
     
-    MoveSet moveset = {};
-    Move backing_buffer[256];
-
-    moveset.cap = 256;
-    // BAD BAD BAD BAD
-    moveset.at = backing_buffer;
+    MoveSet moveset;
     moveset.len = 0;
 
     MoveSet* ms = &moveset;
@@ -174,7 +147,7 @@ static int search(Board* b, int depth, int alpha, int beta) {
         pseudo_legal_moves(b, ms, true);
         swap_color_to_move(*b);
         foreach (Move m, *ms) {
-            if (piece_type(b->board[m.target]) == KING) {
+            if (piece_type(b->board[move_target(m)]) == KING) {
                 in_check = true;
                 break;
             }
@@ -195,53 +168,62 @@ static int search(Board* b, int depth, int alpha, int beta) {
     foreach (Move m, *ms) {
 
         make_move(b, m, true);
-        int evaluation = -search(b, depth - 1, -beta, -alpha);
+        int evaluation = -search(s, b, depth - 1, -beta, -alpha);
         undo_move(b, true);
 
         if (evaluation >= beta) {
-            ttable_put(&tt, b->zobrist, beta, depth, TT_LOWER);
+            ttable_put(&s->tt, b->zobrist, beta, depth, TT_LOWER, NULL_MOVE);
             return beta;
         }
 
         // found a new best move!
         if (evaluation > alpha) {
             alpha = evaluation;
-            if (depth == search_depth) {
+            if (depth == s->search_depth) {
                 // printf("select move %s -> %s\n",
-                    // square_names[m.start],
-                    // square_names[m.target]);
-                best_move = m;
-                best_eval = evaluation;
+                    // square_names[move_start(m)],
+                    // square_names[move_target(m)]);
+                s->best_move = m;
+                s->best_eval = evaluation;
             }
 
             bound = TT_EXACT;
         }
     }
 
-    ttable_put(&tt, b->zobrist, alpha, depth, bound);
+    ttable_put(&s->tt, b->zobrist, alpha, depth, bound, NULL_MOVE);
     return alpha;
 }
 
-static Move select_move(Board* b, int* eval_out) {
+static Move select_move(void* ctx, Board* b, int* eval_out) {
+    Search* s = ctx;
 
-    best_eval = -200000;
-    best_move = NULL_MOVE;
+    s->best_eval = -200000;
+    s->best_move = NULL_MOVE;
 
-    search_depth = 5;
+    s->search_depth = 5;
 
-    *eval_out = search(b, search_depth, -200000, 200000);
+    *eval_out = search(s, b, s->search_depth, -200000, 200000);
+
+    return s->best_move;
+}
 
-    return best_move;
+static void* init() {
+    Search* s = calloc(1, sizeof(Search));
+    ttable_init_mb(&s->tt, 16);
+    return s;
 }
 
-static void init() {
-    // if (ms.at == NULL) da_init(&ms, 64);
-    ttable_init(&tt, 2<<19);
+static void destroy(void* ctx) {
+    Search* s = ctx;
+    ttable_free(&s->tt);
+    free(s);
 }
 
 const Player player_v5 = {
     .name = "v5",
     .init = init,
+    .destroy = destroy,
     .eval = eval,
     .select = select_move,
 };
\ No newline at end of file
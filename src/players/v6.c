@@ -1,8 +1,5 @@
 #include "chess.h"
 
-#define SEARCH_BUFFER_LEN 256
-#define QSEARCH_BUFFER_LEN 256
-
 // #define LOG(...) printf(__VA_ARGS__)
 #define LOG(...)
 
@@ -18,9 +15,22 @@ static const int stalemate_score = -100000;
 static const int stalemate_score = 0;
 #endif
 
-static TransposTable* tt;
-static TransposTable  black_tt;
-static TransposTable  white_tt;
+typedef struct Search {
+    TransposTable* tt;
+    TransposTable  black_tt;
+    TransposTable  white_tt;
+
+    Move best_move;
+    Move best_move_iter;
+    int  best_eval;
+    int  best_eval_iter;
+
+    int  ttable_hits;
+    int  ttable_misses;
+
+    bool search_cancelled;
+    struct timespec ts_start;
+} Search;
 
 static int piece_value(u8 kind) {
     switch (kind) {
@@ -34,28 +44,16 @@ static int piece_value(u8 kind) {
     return 0;
 };
 
-static int eval(Board* b) {
-    int diff_pawns = 0;
-    int diff_rooks = 0;
-    int diff_knights = 0;
-    int diff_bishops = 0;
-    int diff_queens = 0;
-    int diff_kings = 0;
-
-    for_range(i, 0, 64) {
-        u8 p = b->board[i];
-        int offset = piece_color(p) == b->color_to_move ? 1 : -1;
-        switch (piece_type(p)) {
-        case PAWN:   diff_pawns   += offset; break;
-        case ROOK:   diff_rooks   += offset; break;
-        case KNIGHT: diff_knights += offset; break;
-        case BISHOP: diff_bishops += offset; break;
-        case QUEEN:  diff_queens  += offset; break;
-        case KING:   diff_kings   += offset; break;
-        default:
-            break;
-        }
-    }
+static int eval(void* ctx, Board* b) {
+    u8 us = b->color_to_move;
+    u8 them = us ^ BLACK;
+
+    int diff_pawns   = popcount(pieces(b, us, PAWN))   - popcount(pieces(b, them, PAWN));
+    int diff_rooks   = popcount(pieces(b, us, ROOK))   - popcount(pieces(b, them, ROOK));
+    int diff_knights = popcount(pieces(b, us, KNIGHT)) - popcount(pieces(b, them, KNIGHT));
+    int diff_bishops = popcount(pieces(b, us, BISHOP)) - popcount(pieces(b, them, BISHOP));
+    int diff_queens  = popcount(pieces(b, us, QUEEN))  - popcount(pieces(b, them, QUEEN));
+    int diff_kings   = popcount(pieces(b, us, KING))   - popcount(pieces(b, them, KING));
 
     int diff_mobility = pseudo_legal_moves(b, NULL, false);
     swap_color_to_move(*b);
@@ -80,12 +78,12 @@ static void order_moves(Board* b, MoveSet* ms) {
         Move m = ms->at[i];
 
         int score = 0;
-        u8 moved_type = piece_type(b->board[m.start]);
-        u8 captured_type = piece_type(b->board[m.target]);
+        u8 moved_type = piece_type(b->board[move_start(m)]);
+        u8 captured_type = piece_type(b->board[move_target(m)]);
 
         if (captured_type != EMPTY) score += piece_value(captured_type) - piece_value(moved_type);
 
-        if (moved_type == PAWN) switch (m.special) {
+        if (moved_type == PAWN) switch (move_special(m)) {
         case SPECIAL_PROMOTE_QUEEN:  score += piece_value(QUEEN); break;
         case SPECIAL_PROMOTE_KNIGHT: score += piece_value(KNIGHT); break;
         case SPECIAL_PROMOTE_ROOK:   score += piece_value(ROOK); break;
@@ -108,19 +106,12 @@ static void order_moves(Board* b, MoveSet* ms) {
     }
 }
 
-static int q_search(Board* b, int alpha, int beta) {
-    int evaluation = eval(b);
+static int q_search(Search* s, Board* b, int alpha, int beta) {
+    int evaluation = eval(s, b);
     if (evaluation >= beta) return beta;
     alpha = max(alpha, evaluation);
 
-    MoveSet ms = {};
-    // da_init(&ms, 80);
-
-    // RISKY BUSINESS FOR SURE
-    // BAD SANDWICH BAD SANDWICH BAD SANDWICH
-    Move backing_buffer[128];
-    ms.at = backing_buffer;
-    ms.cap = 128;
+    MoveSet ms;
     ms.len = 0;
 
     legal_captures(b, &ms);
@@ -129,34 +120,22 @@ static int q_search(Board* b, int alpha, int beta) {
         Move m = ms.at[i];
 
         make_move(b, m, true);
-        evaluation = -q_search(b, -beta, -alpha);
+        evaluation = -q_search(s, b, -beta, -alpha);
         undo_move(b, true);
 
         if (evaluation >= beta) return beta;
         alpha = max(alpha, evaluation);
     }
 
-    // da_destroy(&ms);
     return alpha;
 }
 
-static Move best_move;
-static Move best_move_iter;
-static int  best_eval;
-static int  best_eval_iter;
-
-static int  ttable_hits = 0;
-static int  ttable_misses = 0;
-
-static bool search_cancelled = false;
-static struct timespec ts_start;
-
-static int search(Board* b, int depth, int search_depth, int alpha, int beta) {
+static int search(Search* s, Board* b, int depth, int search_depth, int alpha, int beta) {
 
-    if (search_cancelled) return 0;
+    if (s->search_cancelled) return 0;
 
     if (depth == search_depth) { // bottom
-        return q_search(b, alpha, beta);
+        return q_search(s, b, alpha, beta);
     }
 
     if (depth != 0) {
@@ -167,12 +146,12 @@ static int search(Board* b, int depth, int search_depth, int alpha, int beta) {
     }
 
     if (depth != 0) {
-        TransposEntry* entry = ttable_get(tt, b->zobrist, depth, alpha, beta);
+        TransposEntry* entry = ttable_get(s->tt, b->zobrist, search_depth - depth, alpha, beta);
         if (entry == NULL) {
-            ttable_misses++;
+            s->ttable_misses++;
         }
         if (entry != NULL) {
-            ttable_hits++;
+            s->ttable_hits++;
             return entry->eval; 
         }
     }
@@ -180,12 +159,7 @@ static int search(Board* b, int depth, int search_depth, int alpha, int beta) {
 
     u8 bound = TT_UPPER;
     
-    MoveSet moveset = {};
-    Move backing_buffer[256];
-
-    moveset.cap = 256;
-    // BAD BAD BAD BAD
-    moveset.at = backing_buffer;
+    MoveSet moveset;
     moveset.len = 0;
 
     MoveSet* ms = &moveset;
@@ -199,7 +173,7 @@ static int search(Board* b, int depth, int search_depth, int alpha, int beta) {
         pseudo_legal_moves(b, ms, true);
         swap_color_to_move(*b);
         foreach (Move m, *ms) {
-            if (piece_type(b->board[m.target]) == KING) {
+            if (piece_type(b->board[move_target(m)]) == KING) {
                 in_check = true;
                 break;
             }
@@ -215,8 +189,8 @@ static int search(Board* b, int depth, int search_depth, int alpha, int beta) {
     {
         struct timespec ts_current;
         clock_gettime(CLOCK_MONOTONIC, &ts_current);
-        if (ts_current.tv_sec - ts_start.tv_sec >= seconds_allotted) {
-            search_cancelled = true;
+        if (ts_current.tv_sec - s->ts_start.tv_sec >= seconds_allotted) {
+            s->search_cancelled = true;
         }
     }
 
@@ -224,26 +198,26 @@ static int search(Board* b, int depth, int search_depth, int alpha, int beta) {
 
     if (depth == 0) {
         // insert best move at front
-        if (!is_move_null(best_move)) {
+        if (!is_move_null(s->best_move)) {
             memmove(&ms->at[1], &ms->at[0], ms->len * sizeof(Move));
-            ms->at[0] = best_move;
+            ms->at[0] = s->best_move;
         }
     }
 
     foreach (Move m, *ms) {
 
-        if (count != 0 && memcmp(&best_move, &m, sizeof(Move)) == 0) {
+        if (count != 0 && moves_equal(s->best_move, m)) {
             continue;
         }
 
         make_move(b, m, true);
-        int evaluation = -search(b, depth + 1, search_depth, -beta, -alpha);
+        int evaluation = -search(s, b, depth + 1, search_depth, -beta, -alpha);
         undo_move(b, true);
 
-        if (search_cancelled) return 0;
+        if (s->search_cancelled) return 0;
 
         if (evaluation >= beta) {
-            ttable_put(tt, b->zobrist, beta, depth, TT_LOWER);
+            ttable_put(s->tt, b->zobrist, beta, search_depth - depth, TT_LOWER, NULL_MOVE);
             return beta;
         }
 
@@ -252,91 +226,100 @@ static int search(Board* b, int depth, int search_depth, int alpha, int beta) {
             alpha = evaluation;
 
             if (depth == 0) {
-                best_move_iter = m;
-                best_eval_iter = evaluation;
+                s->best_move_iter = m;
+                s->best_eval_iter = evaluation;
             }
 
             bound = TT_EXACT;
         }
     }
 
-    ttable_put(tt, b->zobrist, alpha, depth, bound);
+    ttable_put(s->tt, b->zobrist, alpha, search_depth - depth, bound, NULL_MOVE);
     return alpha;
 }
 
 
 
-static int iterative_deepening_search(Board* b) {
-    search_cancelled = false;
-    best_move = best_move_iter = NULL_MOVE;
-    best_eval = best_eval_iter = INT_MIN;
+static int iterative_deepening_search(Search* s, Board* b) {
+    s->search_cancelled = false;
+    s->best_move = s->best_move_iter = NULL_MOVE;
+    s->best_eval = s->best_eval_iter = INT_MIN;
 
-    memset(tt->at, 0, tt->len * sizeof(tt->at[0]));
+    ttable_new_search(s->tt);
 
-    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    clock_gettime(CLOCK_MONOTONIC, &s->ts_start);
 
     for_range(d, 1, 100) {
 
-        best_move_iter = NULL_MOVE;
-        best_eval_iter = INT_MIN;
+        s->best_move_iter = NULL_MOVE;
+        s->best_eval_iter = INT_MIN;
         
-        search(b, 0, d, -400000, 400000);
+        search(s, b, 0, d, -400000, 400000);
 
-        LOG("[V6] iter %d candidate %s -> %s with eval %d\n", d, square_names[best_move_iter.start], square_names[best_move_iter.target], best_eval_iter);
+        LOG("[V6] iter %d candidate %s -> %s with eval %d\n", d, square_names[move_start(s->best_move_iter)], square_names[move_target(s->best_move_iter)], s->best_eval_iter);
         
-        if (!is_move_null(best_move_iter)) {
+        if (!is_move_null(s->best_move_iter)) {
 
-            best_move = best_move_iter;
-            best_eval = best_eval_iter;
+            s->best_move = s->best_move_iter;
+            s->best_eval = s->best_eval_iter;
 
-            // if (best_eval == checkmate_score) {
+            // if (s->best_eval == checkmate_score) {
             //     break; // go for the kill
             // }
         }
 
-        if (search_cancelled) {
+        if (s->search_cancelled) {
             LOG("[V6] search cancelled\n", d);
             break;
         }
     }
 
-    return best_eval;
+    return s->best_eval;
 }
 
-static Move select_move(Board* b, int* eval_out) {
+static Move select_move(void* ctx, Board* b, int* eval_out) {
+    Search* s = ctx;
 
     // choose which transposition table to use.
     // used to use just one table, caused problems with mutliple players evaluating positions incorrectly
     if (b->color_to_move == WHITE) {
-        tt = &white_tt;
+        s->tt = &s->white_tt;
     } else {
-        tt = &black_tt;
+        s->tt = &s->black_tt;
     }
-    if (tt->at == NULL) ttable_init(tt, 2<<18);
+    if (s->tt->at == NULL) ttable_init_mb(s->tt, 8);
 
-    ttable_hits = 0;
-    ttable_misses = 0;
+    s->ttable_hits = 0;
+    s->ttable_misses = 0;
 
-    best_move = best_move_iter = NULL_MOVE;
-    best_eval = best_eval_iter = INT_MIN;
+    s->best_move = s->best_move_iter = NULL_MOVE;
+    s->best_eval = s->best_eval_iter = INT_MIN;
 
     // int search_depth = 5;
 
-    iterative_deepening_search(b);
-    *eval_out = best_eval;
+    iterative_deepening_search(s, b);
+    *eval_out = s->best_eval;
+
+    LOG("[V6] transposition table hits : %d/%d (%f)\n", s->ttable_hits, s->ttable_hits+s->ttable_misses, (s->ttable_hits*100.0f/(s->ttable_hits+s->ttable_misses)));
 
-    LOG("[V6] transposition table hits : %d/%d (%f)\n", ttable_hits, ttable_hits+ttable_misses, (ttable_hits*100.0f/(ttable_hits+ttable_misses)));
+    return s->best_move;
+}
 
-    return best_move;
+static void* init() {
+    return calloc(1, sizeof(Search));
 }
 
-static void init() {
-    // if (ms.at == NULL) da_init(&ms, 64);
+static void destroy(void* ctx) {
+    Search* s = ctx;
+    ttable_free(&s->white_tt);
+    ttable_free(&s->black_tt);
+    free(s);
 }
 
 const Player player_v6 = {
     .name = "v6",
     .init = init,
+    .destroy = destroy,
     .eval = eval,
     .select = select_move,
 };
\ No newline at end of file
@@ -1,14 +1,15 @@
 #include "chess.h"
+#include <pthread.h>
 
-#define SEARCH_BUFFER_LEN 256
-#define QSEARCH_BUFFER_LEN 128
+// hard limit on iterative deepening, also the number of plies killers are kept for
+#define MAX_SEARCH_DEPTH 200
 
-#define LOG(...) printf(__VA_ARGS__)
-// #define LOG(...)
+#define LOG(...) do { if (engine_log) printf(__VA_ARGS__); } while (0)
 
-static const int milliseconds_allotted = 2;
+// when nothing sets a limit, like in the interactive game
+static const u64 default_milliseconds = 2;
 
-static const int checkmate_score = -100000;
+static const int checkmate_score = -MATE_SCORE;
 
 // #define FUCKING_HATE_STALEMATES
 #ifdef FUCKING_HATE_STALEMATES
@@ -17,9 +18,24 @@ static const int stalemate_score = -100000;
 static const int stalemate_score = 0;
 #endif
 
-static TransposTable* tt;
-static TransposTable  black_tt;
-static TransposTable  white_tt;
+// one instance of the engine, everything that lasts from one move to the next
+typedef struct Engine {
+    TransposTable* tt;
+    TransposTable  black_tt;
+    TransposTable  white_tt;
+    size_t hash_megabytes; // what each side's table is currently sized to, follows engine_hash_mb
+
+    // limits for the current search, worked out from search_limits
+    u64 milliseconds_allotted;
+    int max_search_depth;
+
+    atomic_bool search_cancelled;
+    u64 start_milliseconds;
+
+    // every thread of the current search, so their node counts can be added up
+    struct SearchThread* threads;
+    int num_threads;
+} Engine;
 
 static int piece_value(u8 kind) {
     switch (kind) {
@@ -33,66 +49,40 @@ static int piece_value(u8 kind) {
     return 0;
 };
 
-static int eval(Board* b) {
-    int diff_pawns = 0;
-    int diff_rooks = 0;
-    int diff_knights = 0;
-    int diff_bishops = 0;
-    int diff_queens = 0;
-    int diff_kings = 0;
-
-    for_range(i, 0, 64) {
-        u8 p = b->board[i];
-        int offset = piece_color(p) == b->color_to_move ? 1 : -1;
-        switch (piece_type(p)) {
-        case PAWN:   diff_pawns   += offset; break;
-        case ROOK:   diff_rooks   += offset; break;
-        case KNIGHT: diff_knights += offset; break;
-        case BISHOP: diff_bishops += offset; break;
-        case QUEEN:  diff_queens  += offset; break;
-        case KING:   diff_kings   += offset; break;
-        default:
-            break;
-        }
-    }
+// squares each piece could move to, counted off the attack tables instead of generating moves
+static int mobility(Board* b, u8 color) {
+    u64 own = b->bb[color];
+    u64 occupied = occupancy(b);
+
+    int squares = 0;
+    for_bits(i, pieces(b, color, KNIGHT)) squares += popcount(knight_attacks[i] & ~own);
+    for_bits(i, pieces(b, color, BISHOP)) squares += popcount(bishop_attacks(i, occupied) & ~own);
+    for_bits(i, pieces(b, color, ROOK))   squares += popcount(rook_attacks(i, occupied) & ~own);
+    for_bits(i, pieces(b, color, QUEEN))  squares += popcount(queen_attacks(i, occupied) & ~own);
+    return squares;
+}
+
+// tapered material and placement come straight from the board's running sums
+static int eval(void* ctx, Board* b) {
+    // boards the search set up use the network if the front-end loaded one
+    if (b->nnue_enabled) return nnue_eval(b);
+
+    u8 us = b->color_to_move;
+    u8 them = us ^ BLACK;
 
-    int diff_mobility = pseudo_legal_moves(b, NULL, false);
-    swap_color_to_move(*b);
-    diff_mobility -= pseudo_legal_moves(b, NULL, false);
-    swap_color_to_move(*b);
-    // int diff_mobility = 0;
+    int diff_mobility = mobility(b, us) - mobility(b, them);
 
     return 
-        piece_value(KING)   * diff_kings +
-        piece_value(QUEEN)  * diff_queens +
-        piece_value(ROOK)   * diff_rooks +
-        piece_value(BISHOP) * diff_bishops +
-        piece_value(KNIGHT) * diff_knights +
-        piece_value(PAWN)   * diff_pawns +
-        2                   * diff_mobility;
+        tapered_eval(b) +
+        4 * diff_mobility;
 }
 
-static void order_moves(Board* b, MoveSet* ms) {
-    int* scores = alloca(ms->len * sizeof(int));
-    
+// captures are ranked by what the whole exchange on the target square wins,
+// which already counts promotions. scores[] comes back sorted with the moves.
+static void order_moves(Board* b, MoveSet* ms, int* scores) {
     // assign scores
     for_range(i, 0, ms->len) {
-        Move m = ms->at[i];
-
-        int score = 0;
-        u8 moved_type = piece_type(b->board[m.start]);
-        u8 captured_type = piece_type(b->board[m.target]);
-
-        if (captured_type != EMPTY) score += piece_value(captured_type) - piece_value(moved_type);
-
-        if (moved_type == PAWN) switch (m.special) {
-        case SPECIAL_PROMOTE_QUEEN:  score += piece_value(QUEEN); break;
-        case SPECIAL_PROMOTE_KNIGHT: score += piece_value(KNIGHT); break;
-        case SPECIAL_PROMOTE_ROOK:   score += piece_value(ROOK); break;
-        case SPECIAL_PROMOTE_BISHOP: score += piece_value(BISHOP); break;
-        }
-
-        scores[i] = score;
+        scores[i] = see(b, ms->at[i]);
     }
 
     for_range(i, 1, ms->len) {
@@ -108,270 +98,583 @@ static void order_moves(Board* b, MoveSet* ms) {
     }
 }
 
-static int q_search(Board* b, int alpha, int beta) {
-    int evaluation = eval(b);
+// lazy smp - every thread runs the same iterative deepening search on its own copy of the board.
+// they only talk through the shared transposition table, which is enough for the helpers
+// to fill it with results the main thread would have had to search for itself.
+
+typedef struct SearchThread {
+    Engine* engine;
+    Board board;
+    int id;
+    pthread_t handle;
+
+    Move best_move;
+    Move best_move_iter;
+    int  best_eval;
+    int  best_eval_iter;
+
+    int  ttable_hits;
+    int  ttable_misses;
+    _Atomic u64 nodes; // only this thread writes it, others just add it up
+
+    // the last two quiet moves that caused a beta cutoff at each ply
+    Move killers[MAX_SEARCH_DEPTH][2];
+
+    // how often a quiet move from one square to another has cut off, by color.
+    // kept between iterations, so it gets better as the search goes deeper.
+    int history[2][64][64];
+} SearchThread;
+
+// history scores stay within +-HISTORY_MAX
+#define HISTORY_MAX 16384
+
+// the main thread reads the clock once every this many nodes (+1, its a mask)
+#define CLOCK_CHECK_INTERVAL 1023
+
+static u64 milliseconds_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000 + (u64)ts.tv_nsec / 1000000;
+}
+
+forceinline static void count_node(SearchThread* t) {
+    atomic_store_explicit(&t->nodes, atomic_load_explicit(&t->nodes, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// nodes searched by every thread so far
+static u64 total_nodes(Engine* e) {
+    u64 nodes = 0;
+    for_range(i, 0, e->num_threads) nodes += atomic_load_explicit(&e->threads[i].nodes, memory_order_relaxed);
+    return nodes;
+}
+
+// stop is looked at every node by every thread, so it lands right away.
+// only the main thread keeps time and watches the node limit, and the clock only every so often.
+static bool should_stop(SearchThread* t) {
+    Engine* e = t->engine;
+    if (e->search_cancelled) return true;
+    if (search_stop) {
+        e->search_cancelled = true;
+        return true;
+    }
+    if (t->id != 0) return false;
+
+    if (search_limits.nodes != 0 && total_nodes(e) >= search_limits.nodes) {
+        e->search_cancelled = true;
+        return true;
+    }
+    if ((atomic_load_explicit(&t->nodes, memory_order_relaxed) & CLOCK_CHECK_INTERVAL) == 0) {
+        u64 current_milliseconds = milliseconds_now();
+        // while pondering the clock hasnt started yet, it starts from the ponderhit
+        if (search_ponder) e->start_milliseconds = current_milliseconds;
+        if (current_milliseconds - e->start_milliseconds >= e->milliseconds_allotted) {
+            e->search_cancelled = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int q_search(SearchThread* t, Board* b, int alpha, int beta) {
+    if (should_stop(t)) return 0;
+    count_node(t);
+
+    int evaluation = eval(t->engine, b);
     if (evaluation >= beta) return beta;
     alpha = max(alpha, evaluation);
 
-    MoveSet ms = {};
-    // da_init(&ms, 80);
-
-    // RISKY BUSINESS FOR SURE
-    // BAD SANDWICH BAD SANDWICH BAD SANDWICH
-    Move backing_buffer[QSEARCH_BUFFER_LEN];
-    ms.at = backing_buffer;
-    ms.cap = QSEARCH_BUFFER_LEN;
+    MoveSet ms;
     ms.len = 0;
 
+    int scores[MAX_MOVES];
     legal_captures(b, &ms);
-    order_moves(b, &ms);
+    order_moves(b, &ms, scores);
     for_range(i, 0, ms.len) {
         Move m = ms.at[i];
 
+        // losing captures are sorted last, none of them are worth a look
+        if (scores[i] < 0) break;
+
         make_move(b, m, true);
-        evaluation = -q_search(b, -beta, -alpha);
+        evaluation = -q_search(t, b, -beta, -alpha);
         undo_move(b, true);
 
+        if (t->engine->search_cancelled) return 0;
+
         if (evaluation >= beta) return beta;
         alpha = max(alpha, evaluation);
     }
 
-    // da_destroy(&ms);
     return alpha;
 }
 
-static Move best_move;
-static Move best_move_iter;
-static int  best_eval;
-static int  best_eval_iter;
-
-static int  ttable_hits = 0;
-static int  ttable_misses = 0;
-
-static bool search_cancelled = false;
-// static struct timespec ts_start;
-static u64 start_milliseconds;
+// staged move picker. the hash move and killers usually cut off on their own,
+// so nothing else gets generated until they have been tried.
+enum {
+    STAGE_HASH,
+    STAGE_CAPTURES_INIT,
+    STAGE_CAPTURES,
+    STAGE_KILLERS,
+    STAGE_QUIETS_INIT,
+    STAGE_QUIETS,
+    STAGE_DONE,
+};
 
-static int search(Board* b, int depth, int search_depth, int alpha, int beta) {
+typedef struct MovePicker {
+    Board* b;
+    u8 stage;
+
+    Move hash_move;
+    Move killers[2];
+    int killer_index;
+    int (*history)[64];
+
+    // worked out once, every stage below generates from it
+    LegalMasks masks;
+
+    MoveSet moves;
+    int scores[MAX_MOVES];
+    int index;
+    int num_captures; // so the search knows how many moves there are once quiets exist
+} MovePicker;
+
+static void picker_init(MovePicker* p, Board* b, Move hash_move, Move killers[2], int (*history)[64]) {
+    p->b = b;
+    p->stage = STAGE_HASH;
+    legal_masks(b, &p->masks);
+    p->hash_move = is_move_null(hash_move) || is_legal_move_masked(b, hash_move, &p->masks) ? hash_move : NULL_MOVE;
+    p->killers[0] = killers[0];
+    p->killers[1] = killers[1];
+    p->killer_index = 0;
+    p->history = history;
+
+    p->moves.len = 0;
+    p->index = 0;
+    p->num_captures = 0;
+}
 
-    if (search_cancelled) return 0;
+// most valuable victim first, least valuable attacker breaking ties
+static int mvv_lva(Board* b, Move m) {
+    u8 victim = move_special(m) == SPECIAL_EN_PASSANT ? PAWN : piece_type(b->board[move_target(m)]);
+    u8 attacker = piece_type(b->board[move_start(m)]);
+    return piece_value(victim) * 100 - (attacker == KING ? 100 : piece_value(attacker));
+}
 
-    if (depth >= search_depth) { // bottom
-        return q_search(b, alpha, beta);
+static int promotion_value(Move m) {
+    switch (move_special(m)) {
+    case SPECIAL_PROMOTE_QUEEN:  return piece_value(QUEEN);
+    case SPECIAL_PROMOTE_ROOK:   return piece_value(ROOK);
+    case SPECIAL_PROMOTE_BISHOP: return piece_value(BISHOP);
+    case SPECIAL_PROMOTE_KNIGHT: return piece_value(KNIGHT);
     }
+    return 0;
+}
 
-    if (depth != 0) {
-        // avoid stalemate by repetition
-        if (history_contains(b, b->zobrist)) {
-            return stalemate_score;
-        }
+// selection sort, one step at a time. most nodes cut off after a move or two,
+// so sorting the whole list up front is mostly wasted.
+static Move pick_best(MovePicker* p) {
+    int best = p->index;
+    for_range(i, p->index + 1, p->moves.len) {
+        if (p->scores[i] > p->scores[best]) best = i;
     }
 
-    if (depth != 0) {
-        TransposEntry* entry = ttable_get(tt, b->zobrist, depth, alpha, beta);
-        if (entry == NULL) {
-            ttable_misses++;
+    Move m = p->moves.at[best];
+    int score = p->scores[best];
+    p->moves.at[best] = p->moves.at[p->index];
+    p->scores[best] = p->scores[p->index];
+    p->moves.at[p->index] = m;
+    p->scores[p->index] = score;
+    p->index++;
+    return m;
+}
+
+forceinline static bool is_capture(Board* b, Move m) {
+    return piece_type(b->board[move_target(m)]) != EMPTY || move_special(m) == SPECIAL_EN_PASSANT;
+}
+
+// hands back the next move to search, or a null move once there are none left
+static Move next_move(MovePicker* p) {
+    Board* b = p->b;
+
+    switch (p->stage) {
+    case STAGE_HASH:
+        p->stage = STAGE_CAPTURES_INIT;
+        if (!is_move_null(p->hash_move)) return p->hash_move;
+        // fallthrough
+    case STAGE_CAPTURES_INIT:
+        legal_captures_masked(b, &p->moves, &p->masks);
+        p->num_captures = p->moves.len;
+        // captures that lose material in the exchange go after the ones that dont
+        for_range(i, 0, p->moves.len) {
+            Move m = p->moves.at[i];
+            p->scores[i] = mvv_lva(b, m) + promotion_value(m) * 100;
+            if (see(b, m) < 0) p->scores[i] -= 1000000;
         }
-        if (entry != NULL) {
-            ttable_hits++;
-            return entry->eval; 
+        p->stage = STAGE_CAPTURES;
+        // fallthrough
+    case STAGE_CAPTURES:
+        while (p->index < p->moves.len) {
+            Move m = pick_best(p);
+            if (!moves_equal(m, p->hash_move)) return m;
+        }
+        p->stage = STAGE_KILLERS;
+        // fallthrough
+    case STAGE_KILLERS:
+        while (p->killer_index < 2) {
+            Move m = p->killers[p->killer_index++];
+            if (is_move_null(m) || moves_equal(m, p->hash_move)) continue;
+            // a quiet move somewhere else might be a capture here, those were already tried
+            if (is_capture(b, m) || !is_legal_move_masked(b, m, &p->masks)) continue;
+            return m;
+        }
+        p->stage = STAGE_QUIETS_INIT;
+        // fallthrough
+    case STAGE_QUIETS_INIT:
+        p->moves.len = 0;
+        p->index = 0;
+        legal_quiets_masked(b, &p->moves, &p->masks);
+        // promotions first, then whatever has cut off most often
+        for_range(i, 0, p->moves.len) {
+            Move m = p->moves.at[i];
+            p->scores[i] = promotion_value(m) * HISTORY_MAX * 2 + p->history[move_start(m)][move_target(m)];
+        }
+        p->stage = STAGE_QUIETS;
+        // fallthrough
+    case STAGE_QUIETS:
+        while (p->index < p->moves.len) {
+            Move m = pick_best(p);
+            if (moves_equal(m, p->hash_move) || moves_equal(m, p->killers[0]) || moves_equal(m, p->killers[1])) continue;
+            return m;
         }
+        p->stage = STAGE_DONE;
+        // fallthrough
+    case STAGE_DONE:
+    default:
+        return NULL_MOVE;
     }
-    
+}
 
-    u8 bound = TT_UPPER;
-    
-    MoveSet moveset = {};
-    Move backing_buffer[SEARCH_BUFFER_LEN];
-
-    moveset.cap = SEARCH_BUFFER_LEN;
-    // BAD BAD BAD BAD
-    moveset.at = backing_buffer;
-    moveset.len = 0;
-
-    MoveSet* ms = &moveset;
-
-    legal_moves(b, ms);
-
-    if (ms->len == 0) {
-        // test if we're in check
-        bool in_check = false;
-        swap_color_to_move(*b);
-        pseudo_legal_moves(b, ms, true);
-        swap_color_to_move(*b);
-        foreach (Move m, *ms) {
-            if (piece_type(b->board[m.target]) == KING) {
-                in_check = true;
-                break;
-            }
-        }
+static void store_killer(SearchThread* t, int depth, Move m) {
+    if (moves_equal(t->killers[depth][0], m)) return;
+    t->killers[depth][1] = t->killers[depth][0];
+    t->killers[depth][0] = m;
+}
 
-        if (in_check) {
-            return checkmate_score + depth; // checkmated
-        } else {
-            return stalemate_score; // stalemated
-        }
+// moves the score towards +-HISTORY_MAX by bonus, slower the closer it already is,
+// so nothing overflows and moves that stop working fall back down
+forceinline static void update_history(int* score, int bonus) {
+    *score += bonus - *score * abs(bonus) / HISTORY_MAX;
+}
+
+// reward the quiet move that cut off and punish the quiet moves tried before it
+static void store_history(SearchThread* t, int remaining, Move cutoff, Move* quiets_tried, int num_quiets_tried) {
+    int (*history)[64] = t->history[t->board.color_to_move >> 3];
+    int bonus = min(remaining * remaining, HISTORY_MAX / 4);
+
+    update_history(&history[move_start(cutoff)][move_target(cutoff)], bonus);
+    for_range(i, 0, num_quiets_tried) {
+        update_history(&history[move_start(quiets_tried[i])][move_target(quiets_tried[i])], -bonus);
     }
+}
 
-    if (depth == 0 && !is_move_null(best_move)) {
+// mate scores count plies from the root, which means nothing once the same position
+// comes up at another ply or on a later move. the table keeps them counted from the node instead.
+forceinline static bool is_mate_score(int eval) {
+    return abs(eval) >= -checkmate_score - MAX_SEARCH_DEPTH;
+}
 
-        make_move(b, best_move, true);
-        int evaluation = -search(b, depth + 1, search_depth, -beta, -alpha);
-        undo_move(b, true);
+forceinline static int score_to_tt(int eval, int depth) {
+    if (!is_mate_score(eval)) return eval;
+    return eval < 0 ? eval - depth : eval + depth;
+}
 
-        if (search_cancelled) return 0;
+forceinline static int score_from_tt(int eval, int depth) {
+    if (!is_mate_score(eval)) return eval;
+    return eval < 0 ? eval + depth : eval - depth;
+}
 
-        if (evaluation >= beta) {
-            ttable_put(tt, b->zobrist, beta, depth, TT_LOWER);
-            return beta;
-        }
+static int search(SearchThread* t, int depth, int search_depth, int alpha, int beta) {
+    Engine* e = t->engine;
+    Board* b = &t->board;
 
-        // found a new best move!
-        if (evaluation > alpha) {
-            alpha = evaluation;
+    if (should_stop(t)) return 0;
+    count_node(t);
 
-            if (depth == 0) {
-                best_move_iter = best_move;
-                best_eval_iter = evaluation;
-            }
+    if (depth >= search_depth) { // bottom
+        return q_search(t, b, alpha, beta);
+    }
 
-            bound = TT_EXACT;
+    if (depth != 0) {
+        // avoid stalemate by repetition
+        if (history_contains(b, b->zobrist)) {
+            return stalemate_score;
         }
     }
 
-    {
-        struct timespec ts_current;
-        clock_gettime(CLOCK_MONOTONIC, &ts_current);
-        u64 current_milliseconds = (u64)ts_current.tv_sec * 1000;
-        current_milliseconds += (u64)ts_current.tv_nsec / 1000000;
-        if (current_milliseconds - start_milliseconds >= milliseconds_allotted) {
-            search_cancelled = true;
+    // the move to try before anything else. at the root thats the best move
+    // of the last iteration, everywhere else its whatever the table remembers.
+    Move hash_move = depth == 0 ? t->best_move : NULL_MOVE;
+
+    if (depth != 0) {
+        TransposEntry* entry = ttable_get(e->tt, b->zobrist, search_depth - depth,
+            score_to_tt(alpha, depth), score_to_tt(beta, depth));
+        if (entry == NULL) {
+            t->ttable_misses++;
         }
+        if (entry != NULL) {
+            t->ttable_hits++;
+            return score_from_tt(entry->eval, depth);
+        }
+
+        entry = ttable_probe(e->tt, b->zobrist);
+        if (entry != NULL) hash_move = entry->move;
     }
+    
+
+    u8 bound = TT_UPPER;
+    Move best_move = NULL_MOVE;
 
-    order_moves(b, ms);
+    MovePicker picker;
+    picker_init(&picker, b, hash_move, t->killers[depth], t->history[b->color_to_move >> 3]);
 
-    for_range(i, 0, ms->len) {
-        Move m = ms->at[i];
+    // only the first few get punished if a later quiet move cuts off
+    Move quiets_tried[32];
+    int num_quiets_tried = 0;
 
-        if (depth == 0 && m.start == best_move.start && m.target == best_move.target) continue;
+    int moves_searched = 0;
+    for (Move m = next_move(&picker); !is_move_null(m); m = next_move(&picker)) {
+        bool quiet = !is_capture(b, m);
 
         int evaluation;
         make_move(b, m, true);
 
-        if (search_depth - depth > 4 && i >= ((2*ms->len)/3)) {
+        // late quiet moves. how late is judged against every legal move in the position,
+        // which is only known once the quiets have been generated
+        int num_moves = picker.num_captures + picker.moves.len;
+        if (picker.stage == STAGE_QUIETS && search_depth - depth > 4 && moves_searched >= ((2*num_moves)/3)) {
             // search a little smaller
-            evaluation = -search(b, depth + 1, search_depth - 1, -beta, -alpha);
+            evaluation = -search(t, depth + 1, search_depth - 1, -beta, -alpha);
 
             // position might be better than expected, expore this further
             if (evaluation > alpha) goto standard_eval;
         } else {
             standard_eval:
-            evaluation = -search(b, depth + 1, search_depth, -beta, -alpha);
+            evaluation = -search(t, depth + 1, search_depth, -beta, -alpha);
         }
 
         undo_move(b, true);
+        moves_searched++;
 
-        if (search_cancelled) return 0;
+        if (e->search_cancelled) return 0;
 
         if (evaluation >= beta) {
-            ttable_put(tt, b->zobrist, beta, depth, TT_LOWER);
+            if (quiet) {
+                store_killer(t, depth, m);
+                store_history(t, search_depth - depth, m, quiets_tried, num_quiets_tried);
+            }
+            ttable_put(e->tt, b->zobrist, score_to_tt(beta, depth), search_depth - depth, TT_LOWER, m);
             return beta;
         }
 
+        if (quiet && num_quiets_tried < 32) quiets_tried[num_quiets_tried++] = m;
+
         // found a new best move!
         if (evaluation > alpha) {
             alpha = evaluation;
+            best_move = m;
 
             if (depth == 0) {
-                best_move_iter = m;
-                best_eval_iter = evaluation;
+                t->best_move_iter = m;
+                t->best_eval_iter = evaluation;
             }
 
             bound = TT_EXACT;
         }
     }
 
-    ttable_put(tt, b->zobrist, alpha, depth, bound);
+    if (moves_searched == 0) {
+        if (is_in_check(b, b->color_to_move)) {
+            return checkmate_score + depth; // checkmated
+        } else {
+            return stalemate_score; // stalemated
+        }
+    }
+
+    ttable_put(e->tt, b->zobrist, score_to_tt(alpha, depth), search_depth - depth, bound, best_move);
     return alpha;
 }
 
+static void* iterative_deepening_search(void* arg) {
+    SearchThread* t = arg;
+    Engine* e = t->engine;
 
+    t->best_move = t->best_move_iter = NULL_MOVE;
+    t->best_eval = t->best_eval_iter = INT_MIN;
 
-static int iterative_deepening_search(Board* b) {
-    search_cancelled = false;
-    best_move = best_move_iter = NULL_MOVE;
-    best_eval = best_eval_iter = INT_MIN;
-
-    memset(tt->at, 0, tt->len * sizeof(tt->at[0]));
+    // helpers start a ply apart so they dont all walk the same tree in lockstep
+    int first_depth = 1 + (t->id % 2);
 
-    struct timespec ts_start;
-    clock_gettime(CLOCK_MONOTONIC, &ts_start);
-    start_milliseconds = ((u64)ts_start.tv_sec * 1000) + ((u64)ts_start.tv_nsec / 1000000);
+    for_range_incl(d, first_depth, e->max_search_depth) {
 
-    // hard limit at 200 search iterations 
-    for_range_incl(d, 1, 200) {
-
-        best_move_iter = NULL_MOVE;
-        best_eval_iter = INT_MIN;
+        t->best_move_iter = NULL_MOVE;
+        t->best_eval_iter = INT_MIN;
         
-        search(b, 0, d, -400000, 400000);
+        search(t, 0, d, -400000, 400000);
 
-        if (best_eval_iter != INT_MIN) LOG("[V8] iter %d candidate %s -> %s with eval %d\n", d, square_names[best_move_iter.start], square_names[best_move_iter.target], best_eval_iter);
+        if (t->id == 0 && t->best_eval_iter != INT_MIN) LOG("[V8] iter %d candidate %s -> %s with eval %d\n", d, square_names[move_start(t->best_move_iter)], square_names[move_target(t->best_move_iter)], t->best_eval_iter);
         
-        if (!is_move_null(best_move_iter)) {
+        if (!is_move_null(t->best_move_iter)) {
+
+            t->best_move = t->best_move_iter;
+            t->best_eval = t->best_eval_iter;
 
-            best_move = best_move_iter;
-            best_eval = best_eval_iter;
+            if (t->id == 0 && search_report != NULL && !e->search_cancelled) {
+                search_report(d, t->best_eval, total_nodes(e), t->best_move);
+            }
 
             // if (best_eval == checkmate_score) {
             //     break; // go for the kill
             // }
         }
 
-        if (search_cancelled) {
-            LOG("[V8] search cancelled\n", d);
+        if (e->search_cancelled) {
+            if (t->id == 0) LOG("[V8] search cancelled\n", d);
             break;
         }
     }
 
-    return best_eval;
+    return NULL;
 }
 
-static Move select_move(Board* b, int* eval_out) {
+// how long this move gets. a fixed movetime is used as is, otherwise a slice of the clock.
+// searches limited only by depth or nodes dont get timed at all.
+static u64 allot_time(Board* b) {
+    SearchLimits* l = &search_limits;
+    u8 us = b->color_to_move >> 3;
+
+    if (l->movetime != 0) return l->movetime;
+    if (l->time[us] != 0) {
+        int moves_left = l->moves_to_go > 0 ? l->moves_to_go : 30;
+        u64 slice = l->time[us] / moves_left + l->increment[us] / 2;
+        // keep something back for the gui to talk to us
+        u64 reserve = min(l->time[us] / 2, 50);
+        return min(slice, l->time[us] - reserve);
+    }
+    if (l->depth != 0 || l->nodes != 0 || l->infinite) return UINT64_MAX;
+    return default_milliseconds;
+}
+
+static Move select_move(void* ctx, Board* b, int* eval_out) {
+    Engine* e = ctx;
+
+    int search_threads = max(engine_threads, 1);
+
+    e->milliseconds_allotted = allot_time(b);
+    e->max_search_depth = search_limits.depth > 0 ? min(search_limits.depth, MAX_SEARCH_DEPTH) : MAX_SEARCH_DEPTH;
+
+    if (e->hash_megabytes != engine_hash_mb) {
+        e->hash_megabytes = engine_hash_mb;
+        if (e->white_tt.at != NULL) ttable_resize(&e->white_tt, e->hash_megabytes);
+        if (e->black_tt.at != NULL) ttable_resize(&e->black_tt, e->hash_megabytes);
+    }
 
     // choose which transposition table to use.
     // used to use just one table, caused problems with mutliple players evaluating positions incorrectly
     if (b->color_to_move == WHITE) {
-        tt = &white_tt;
+        e->tt = &e->white_tt;
     } else {
-        tt = &black_tt;
+        e->tt = &e->black_tt;
     }
-    if (tt->at == NULL) ttable_init(tt, 2<<18);
+    if (e->tt->at == NULL) ttable_init_mb(e->tt, e->hash_megabytes);
 
-    ttable_hits = 0;
-    ttable_misses = 0;
+    // keep the last search's work, it just gets aged out as this one fills the table
+    ttable_new_search(e->tt);
 
-    best_move = best_move_iter = NULL_MOVE;
-    best_eval = best_eval_iter = INT_MIN;
+    e->search_cancelled = false;
+    e->start_milliseconds = milliseconds_now();
 
-    // int search_depth = 5;
+    SearchThread* threads = calloc(search_threads, sizeof(SearchThread));
+    for_range(i, 0, search_threads) {
+        threads[i].engine = e;
+        threads[i].id = i;
+        copy_board(&threads[i].board, b);
+        // the game's board doesnt carry accumulators, only the search's copies do
+        nnue_enable(&threads[i].board);
+    }
+    e->threads = threads;
+    e->num_threads = search_threads;
 
-    iterative_deepening_search(b);
-    *eval_out = best_eval;
+    // the calling thread is the main search thread, the rest are helpers
+    for_range(i, 1, search_threads) {
+        pthread_create(&threads[i].handle, NULL, iterative_deepening_search, &threads[i]);
+    }
+    iterative_deepening_search(&threads[0]);
+
+    // the main thread only gives up when time is out, which cancels the helpers too
+    e->search_cancelled = true;
+    for_range(i, 1, search_threads) {
+        pthread_join(threads[i].handle, NULL);
+    }
 
-    LOG("[V8] transposition table hits : %d/%d (%f)\n", ttable_hits, ttable_hits+ttable_misses, (ttable_hits*100.0f/(ttable_hits+ttable_misses)));
+    int ttable_hits = 0;
+    int ttable_misses = 0;
+    for_range(i, 0, search_threads) {
+        ttable_hits += threads[i].ttable_hits;
+        ttable_misses += threads[i].ttable_misses;
+    }
+
+    Move best_move = threads[0].best_move;
+    *eval_out = threads[0].best_eval;
+
+    // stopped before the first iteration got through, any legal move beats none
+    if (is_move_null(best_move)) {
+        MoveSet ms;
+        ms.len = 0;
+        legal_moves(b, &ms);
+        if (ms.len != 0) best_move = ms.at[0];
+        *eval_out = 0;
+    }
+
+    // whatever the table thinks the opponent answers with, so theres something to ponder on
+    search_ponder_move = NULL_MOVE;
+    if (!is_move_null(best_move)) {
+        Board* root = &threads[0].board;
+        make_move(root, best_move, true);
+        TransposEntry* entry = ttable_probe(e->tt, root->zobrist);
+        if (entry != NULL && !is_move_null(entry->move) && is_legal_move(root, entry->move)) {
+            search_ponder_move = entry->move;
+        }
+        undo_move(root, true);
+    }
+
+    LOG("[V8] transposition table hits : %d/%d (%f) over %d threads\n", ttable_hits, ttable_hits+ttable_misses, (ttable_hits*100.0f/(ttable_hits+ttable_misses)), search_threads);
+
+    for_range(i, 0, search_threads) {
+        destroy_board(&threads[i].board);
+    }
+    free(threads);
+    e->threads = NULL;
+    e->num_threads = 0;
 
     return best_move;
 }
 
-static void init() {
-    // if (ms.at == NULL) da_init(&ms, 64);
+static void* init() {
+    if (nnue_loaded) LOG("[V8] evaluating with the network\n");
+    return calloc(1, sizeof(Engine));
+}
+
+static void destroy(void* ctx) {
+    Engine* e = ctx;
+    ttable_free(&e->white_tt);
+    ttable_free(&e->black_tt);
+    free(e);
 }
 
 const Player player_v8 = {
     .name = "v8",
     .init = init,
+    .destroy = destroy,
     .eval = eval,
     .select = select_move,
 };
\ No newline at end of file
@@ -0,0 +1,361 @@
+#include "chess.h"
+#include <math.h>
+#include <pthread.h>
+
+// headless matches between two players, for measuring engine changes.
+// every opening is played twice with the colors swapped, and the games are spread over
+// a pool of worker threads. every game gets its own instances of both players,
+// so nothing carries over from one game to the next.
+
+// games that go on this long are called a draw
+#define TOURNAMENT_MAX_PLIES 600
+
+#define OPENING_LINE_LEN 1024
+
+// a few plies into the common openings, so games dont all start from the same spot
+static char* default_openings[] = {
+    "e2e4 e7e5 g1f3 b8c6 f1b5",
+    "e2e4 e7e5 g1f3 b8c6 f1c4",
+    "e2e4 c7c5 g1f3 d7d6",
+    "e2e4 c7c5 b1c3 b8c6",
+    "e2e4 e7e6 d2d4 d7d5",
+    "e2e4 c7c6 d2d4 d7d5",
+    "e2e4 d7d5 e4d5 d8d5",
+    "d2d4 d7d5 c2c4 e7e6",
+    "d2d4 d7d5 c2c4 c7c6",
+    "d2d4 g8f6 c2c4 e7e6 b1c3 f8b4",
+    "d2d4 g8f6 c2c4 g7g6 b1c3 f8g7",
+    "d2d4 f7f5 g2g3 g8f6",
+    "c2c4 e7e5 b1c3 g8f6",
+    "g1f3 d7d5 g2g3 g8f6",
+    "e2e4 g7g6 d2d4 f8g7",
+    "b2b3 e7e5 c1b2 b8c6",
+};
+
+enum {
+    GAME_WHITE_WINS,
+    GAME_BLACK_WINS,
+    GAME_DRAW,
+};
+
+enum {
+    REASON_CHECKMATE,
+    REASON_STALEMATE,
+    REASON_REPETITION,
+    REASON_TWO_KINGS,
+    REASON_MOVE_LIMIT,
+    REASON_BAD_MOVE, // the player returned a null or illegal move while it had legal ones
+
+    REASON_COUNT,
+};
+
+static char* reason_names[] = {
+    [REASON_CHECKMATE]  = "checkmate",
+    [REASON_STALEMATE]  = "stalemate",
+    [REASON_REPETITION] = "repetition",
+    [REASON_TWO_KINGS]  = "two kings",
+    [REASON_MOVE_LIMIT] = "move limit",
+    [REASON_BAD_MOVE]   = "bad move",
+};
+
+typedef struct GameRecord {
+    int game;
+    u8 result;
+    u8 reason;
+    int plies;
+} GameRecord;
+
+typedef struct Tournament {
+    const Player* a;
+    const Player* b;
+    char** openings;
+    int num_openings;
+    int games;
+    int jobs;
+
+    _Atomic int next_game;
+
+    // results so far, from player a's point of view
+    pthread_mutex_t lock;
+    int wins, draws, losses;
+    int reasons[REASON_COUNT];
+} Tournament;
+
+static u64 milliseconds_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000 + (u64)ts.tv_nsec / 1000000;
+}
+
+// an opening is either a fen or a list of moves from the start position
+static bool load_opening(Board* b, char* opening) {
+    if (strchr(opening, '/') != NULL) {
+        load_board(b, opening);
+        return true;
+    }
+
+    load_board(b, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -");
+
+    char moves[OPENING_LINE_LEN];
+    strncpy(moves, opening, sizeof(moves) - 1);
+    moves[sizeof(moves) - 1] = '\0';
+
+    char* save = NULL;
+    for (char* token = strtok_r(moves, " ", &save); token != NULL; token = strtok_r(NULL, " ", &save)) {
+        // the game and its searches still have to fit on the move stack after this
+        if (b->move_stack_len + TOURNAMENT_MAX_PLIES + SEARCH_PLY_RESERVE >= MAX_GAME_PLIES) return false;
+        Move m = parse_move(b, token);
+        if (is_move_null(m)) return false;
+        make_move(b, m, true);
+    }
+    return true;
+}
+
+// play one game out, adjudicated the same way as the interactive game in main.c
+static GameRecord play_game(const Player* white, void* white_ctx, const Player* black, void* black_ctx, char* opening) {
+    GameRecord record = {};
+
+    Board b = {};
+    init_board(&b);
+    load_opening(&b, opening);
+
+    MoveSet possible_moves;
+
+    while (true) {
+        const Player* player_to_move = b.color_to_move ? black : white;
+        void* ctx_to_move = b.color_to_move ? black_ctx : white_ctx;
+        u8 opponent_wins = b.color_to_move ? GAME_WHITE_WINS : GAME_BLACK_WINS;
+
+        possible_moves.len = 0;
+        legal_moves(&b, &possible_moves);
+
+        if (possible_moves.len == 0) {
+            bool mated = is_in_check(&b, b.color_to_move);
+            record.result = mated ? opponent_wins : GAME_DRAW;
+            record.reason = mated ? REASON_CHECKMATE : REASON_STALEMATE;
+            break;
+        }
+        if (is_two_king_draw(&b)) {
+            record.result = GAME_DRAW;
+            record.reason = REASON_TWO_KINGS;
+            break;
+        }
+        if (record.plies >= TOURNAMENT_MAX_PLIES) {
+            record.result = GAME_DRAW;
+            record.reason = REASON_MOVE_LIMIT;
+            break;
+        }
+
+        int eval = 0;
+        Move move = player_to_move->select(ctx_to_move, &b, &eval);
+        if (is_move_null(move) || !is_legal_move(&b, move)) {
+            record.result = opponent_wins;
+            record.reason = REASON_BAD_MOVE;
+            break;
+        }
+
+        make_move(&b, move, true);
+        record.plies++;
+
+        if (history_contains(&b, b.zobrist)) {
+            record.result = GAME_DRAW;
+            record.reason = REASON_REPETITION;
+            break;
+        }
+    }
+
+    destroy_board(&b);
+    return record;
+}
+
+static void report_game(Tournament* t, GameRecord record) {
+    bool a_is_white = record.game % 2 == 0;
+
+    pthread_mutex_lock(&t->lock);
+    if (record.result == GAME_DRAW) {
+        t->draws++;
+    } else if ((record.result == GAME_WHITE_WINS) == a_is_white) {
+        t->wins++;
+    } else {
+        t->losses++;
+    }
+    t->reasons[record.reason]++;
+
+    printf("game %-5d %-6s %3d plies  %-10s  +%d =%d -%d\n",
+        record.game + 1,
+        record.result == GAME_DRAW ? "1/2" : record.result == GAME_WHITE_WINS ? "1-0" : "0-1",
+        record.plies, reason_names[record.reason], t->wins, t->draws, t->losses);
+    fflush(stdout);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// workers take the next unplayed game until there are none left.
+// game g plays opening g/2, with player a as white on even games.
+static void* run_worker(void* arg) {
+    Tournament* t = arg;
+
+    while (true) {
+        int g = atomic_fetch_add(&t->next_game, 1);
+        if (g >= t->games) break;
+
+        char* opening = t->openings[(g / 2) % t->num_openings];
+        void* a_ctx = t->a->init();
+        void* b_ctx = t->b->init();
+
+        GameRecord record = g % 2 == 0
+            ? play_game(t->a, a_ctx, t->b, b_ctx, opening)
+            : play_game(t->b, b_ctx, t->a, a_ctx, opening);
+        record.game = g;
+        report_game(t, record);
+
+        t->a->destroy(a_ctx);
+        t->b->destroy(b_ctx);
+    }
+    return NULL;
+}
+
+// elo difference that an expected score of p corresponds to
+static double elo_from_score(double p) {
+    p = max(min(p, 0.999), 0.001);
+    return 400.0 * log10(p / (1.0 - p));
+}
+
+static void print_score(Tournament* t, int wins, int draws, int losses) {
+    int n = wins + draws + losses;
+    if (n == 0) return;
+
+    double p = (wins + 0.5 * draws) / n;
+
+    // a clean sweep only says the gap is bigger than this match can measure
+    if (wins == n || losses == n) {
+        printf("%s vs %s: %d games  +%d =%d -%d  score %.1f%%  elo %sinf\n",
+            t->a->name, t->b->name, n, wins, draws, losses, p * 100, wins == n ? "+" : "-");
+        return;
+    }
+
+    // 95% interval from the spread of the per-game scores
+    double variance = (wins * (1.0 - p) * (1.0 - p) + draws * (0.5 - p) * (0.5 - p) + losses * p * p) / n;
+    double margin = 1.96 * sqrt(variance / n);
+    double elo = elo_from_score(p);
+    double error = fabs(elo_from_score(p + margin) - elo_from_score(p - margin)) / 2;
+
+    printf("%s vs %s: %d games  +%d =%d -%d  score %.1f%%  elo %+.1f +- %.1f\n",
+        t->a->name, t->b->name, n, wins, draws, losses, p * 100, elo, error);
+}
+
+static char** read_openings(char* path, int* count) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return NULL;
+
+    int cap = 64;
+    char** openings = malloc(sizeof(char*) * cap);
+    *count = 0;
+
+    char line[OPENING_LINE_LEN];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        if (*count == cap) {
+            cap *= 2;
+            openings = realloc(openings, sizeof(char*) * cap);
+        }
+        openings[(*count)++] = strdup(line);
+    }
+
+    fclose(f);
+    return openings;
+}
+
+// chess tournament <player a> <player b> [-n games] [-j jobs] [-o openings] [-t movetime]
+// openings is a file with one fen or move list (e2e4 e7e5 ...) per line.
+// -j 0 runs one worker per core. -t gives players that honour search limits a fixed time per move.
+#define TOURNAMENT_USAGE "usage: chess tournament <player a> <player b> [-n games] [-j jobs] [-o openings] [-t movetime]\n"
+
+int tournament_main(int argc, char** argv) {
+    if (argc < 2) {
+        printf(TOURNAMENT_USAGE);
+        return EXIT_FAILURE;
+    }
+
+    Tournament t = {
+        .a = find_player(argv[0]),
+        .b = find_player(argv[1]),
+        .openings = default_openings,
+        .num_openings = sizeof(default_openings) / sizeof(default_openings[0]),
+        .games = 100,
+        .jobs = 0,
+    };
+
+    for_range(i, 0, 2) {
+        const Player* p = i == 0 ? t.a : t.b;
+        if (p == NULL || p == &player_user) {
+            printf("'%s' cant play in a tournament\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int i = 2; i < argc; i += 2) {
+        char* flag = argv[i];
+        char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            printf("'%s' needs a value\n" TOURNAMENT_USAGE, flag);
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(flag, "-n") == 0) {
+            t.games = max(atoi(value), 1);
+        } else if (strcmp(flag, "-j") == 0) {
+            t.jobs = atoi(value);
+        } else if (strcmp(flag, "-t") == 0) {
+            search_limits.movetime = max(atoi(value), 1);
+        } else if (strcmp(flag, "-o") == 0) {
+            t.openings = read_openings(value, &t.num_openings);
+            if (t.openings == NULL || t.num_openings == 0) {
+                printf("no openings in '%s'\n", value);
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("unknown option '%s'\n" TOURNAMENT_USAGE, flag);
+            return EXIT_FAILURE;
+        }
+    }
+    if (t.jobs <= 0) t.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    t.jobs = max(min(t.jobs, t.games), 1);
+
+    // catch a bad opening here rather than in every worker
+    Board b = {};
+    init_board(&b);
+    for_range(i, 0, t.num_openings) {
+        if (!load_opening(&b, t.openings[i])) {
+            printf("bad opening '%s'\n", t.openings[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    destroy_board(&b);
+
+    // each worker is one game at a time, more threads would just fight over the cores
+    engine_log = false;
+    engine_threads = 1;
+
+    printf("%s vs %s, %d games from %d openings over %d workers\n", t.a->name, t.b->name, t.games, t.num_openings, t.jobs);
+    fflush(stdout);
+
+    pthread_mutex_init(&t.lock, NULL);
+    u64 start = milliseconds_now();
+
+    pthread_t* pool = malloc(sizeof(pthread_t) * t.jobs);
+    for_range(i, 0, t.jobs) pthread_create(&pool[i], NULL, run_worker, &t);
+    for_range(i, 0, t.jobs) pthread_join(pool[i], NULL);
+    free(pool);
+
+    printf("\n");
+    for_range(i, 0, REASON_COUNT) {
+        if (t.reasons[i] != 0) printf("%-10s %d\n", reason_names[i], t.reasons[i]);
+    }
+    printf("%llu ms\n", milliseconds_now() - start);
+    print_score(&t, t.wins, t.draws, t.losses);
+
+    pthread_mutex_destroy(&t.lock);
+    return t.wins + t.draws + t.losses == t.games ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,32 +1,203 @@
 #include "chess.h"
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// back big tables with transparent huge pages where the os supports it.
+// fewer tlb misses on random probes, no effect elsewhere.
+bool ttable_huge_pages = true;
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static TransposBucket* alloc_buckets(u64 len) {
+    size_t size = sizeof(TransposBucket) * len;
+    size_t alignment = alignof(TransposBucket);
+    if (ttable_huge_pages && size >= HUGE_PAGE_SIZE) alignment = HUGE_PAGE_SIZE;
+
+    TransposBucket* at = aligned_alloc(alignment, size);
+    assert(at != NULL);
+#ifdef MADV_HUGEPAGE
+    if (alignment == HUGE_PAGE_SIZE) madvise(at, size, MADV_HUGEPAGE);
+#endif
+    memset(at, 0, size);
+    return at;
+}
+
+// largest power of two that is <= n
+static u64 round_down_pow_2(u64 n) {
+    if (n == 0) return 1;
+    return 1ull << (63 - __builtin_clzll(n));
+}
+
+// len is in entries, rounded down to a power of two number of buckets
 void ttable_init(TransposTable* tt, u64 len) {
-    tt->len = len;
-    tt->at = malloc(sizeof(TransposEntry) * tt->len);
-    assert(tt->at != NULL);
-    memset(tt->at, 0, sizeof(TransposEntry) * tt->len);
+    tt->len = round_down_pow_2(len / TT_BUCKET_SIZE);
+    tt->at = alloc_buckets(tt->len);
 }
 
+// size the table from a memory budget instead of an entry count
+void ttable_init_mb(TransposTable* tt, size_t mb) {
+    tt->len = round_down_pow_2(((u64)mb * 1024 * 1024) / sizeof(TransposBucket));
+    tt->at = alloc_buckets(tt->len);
+}
+
+// throws away everything in the table
+void ttable_resize(TransposTable* tt, size_t mb) {
+    ttable_free(tt);
+    ttable_init_mb(tt, mb);
+}
+
+void ttable_clear(TransposTable* tt) {
+    memset(tt->at, 0, sizeof(TransposBucket) * tt->len);
+}
+
+void ttable_free(TransposTable* tt) {
+    free(tt->at);
+    tt->at = NULL;
+    tt->len = 0;
+}
+
+// multiply-shift instead of a modulo, maps the hash onto [0, len) with one multiply
+forceinline static TransposBucket* ttable_bucket(TransposTable* tt, u64 zobrist) {
+    return &tt->at[(u64)(((unsigned __int128)zobrist * tt->len) >> 64)];
+}
+
+// evals are well inside 24 bits (mate scores are around 100000), depths inside 8,
+// and a move is already 16 bits
+forceinline static u64 pack_entry(int eval, u16 depth, u8 kind, u8 age, Move move) {
+    return ((u64)(u32)eval & 0xFFFFFF) | (u64)move << 24 |
+        (u64)(u8)depth << 40 | (u64)kind << 48 | (u64)age << 56;
+}
+
+forceinline static TransposEntry unpack_entry(u64 zobrist, u64 data) {
+    return (TransposEntry) {
+        .zobrist = zobrist,
+        .eval = (int)((u32)data << 8) >> 8, // sign extend
+        .depth = (u8)(data >> 40),
+        .kind = (u8)(data >> 48),
+        .age = (u8)(data >> 56),
+        .move = (Move)(data >> 24),
+    };
+}
+
+forceinline static u16 slot_depth(u64 data) {
+    return (u8)(data >> 40);
+}
+
+forceinline static Move slot_move(u64 data) {
+    return (Move)(data >> 24);
+}
+
+forceinline static u8 slot_age(u64 data) {
+    return (u8)(data >> 56);
+}
+
+// start a new search. entries from earlier searches stay probe-able,
+// but they get replaced before anything the current search wrote.
+void ttable_new_search(TransposTable* tt) {
+    tt->generation++;
+}
+
+// returned entries are copies, each thread gets its own
+static _Thread_local TransposEntry found;
+
 TransposEntry* ttable_get(TransposTable* tt, u64 zobrist, int depth, int alpha, int beta) {
-    TransposEntry* e = &tt->at[zobrist % tt->len];
-    if (e->zobrist != zobrist) return NULL;
-
-    // only consider evaluations that deeper or as deep as our current search
-    if (e->depth <= depth) {
-        // use information about the eval to figure out 
-        // if we should keep searching or not
-        if (e->kind == TT_UPPER && e->eval <= alpha) return e;
-        if (e->kind == TT_LOWER && e->eval >= beta)  return e;
+    TransposBucket* bucket = ttable_bucket(tt, zobrist);
+
+    for_range(i, 0, TT_BUCKET_SIZE) {
+        u64 key  = atomic_load_explicit(&bucket->slots[i].key, memory_order_relaxed);
+        u64 data = atomic_load_explicit(&bucket->slots[i].data, memory_order_relaxed);
+        if ((key ^ data) != zobrist) continue;
+
+        TransposEntry e = unpack_entry(zobrist, data);
+
+        // depth is how far the entry was searched below this position, so it only
+        // answers for a search at least as deep as the one asking
+        if (e.depth >= depth) {
+            // use information about the eval to figure out 
+            // if we should keep searching or not
+            if ((e.kind == TT_UPPER && e.eval <= alpha) ||
+                (e.kind == TT_LOWER && e.eval >= beta)) {
+                found = e;
+                return &found;
+            }
+        }
+        return NULL;
     }
 
     return NULL;
 }
 
-void ttable_put(TransposTable* tt, u64 zobrist, int eval, u16 depth, u8 kind) {
-    tt->at[zobrist % tt->len] = (TransposEntry) {
-        .zobrist = zobrist,
-        .eval = eval,
-        .depth = depth,
-        .kind = kind,
-    };
-}
\ No newline at end of file
+// any entry for this position, whether or not it can cut off.
+// mostly useful for the move stored in it.
+TransposEntry* ttable_probe(TransposTable* tt, u64 zobrist) {
+    TransposBucket* bucket = ttable_bucket(tt, zobrist);
+
+    for_range(i, 0, TT_BUCKET_SIZE) {
+        u64 key  = atomic_load_explicit(&bucket->slots[i].key, memory_order_relaxed);
+        u64 data = atomic_load_explicit(&bucket->slots[i].data, memory_order_relaxed);
+        if ((key ^ data) != zobrist) continue;
+
+        found = unpack_entry(zobrist, data);
+        return &found;
+    }
+
+    return NULL;
+}
+
+forceinline static void slot_store(TransposSlot* slot, u64 zobrist, u64 data) {
+    atomic_store_explicit(&slot->key, zobrist ^ data, memory_order_relaxed);
+    atomic_store_explicit(&slot->data, data, memory_order_relaxed);
+}
+
+void ttable_put(TransposTable* tt, u64 zobrist, int eval, u16 depth, u8 kind, Move move) {
+    TransposBucket* bucket = ttable_bucket(tt, zobrist);
+    u64 data = pack_entry(eval, depth, kind, tt->generation, move);
+
+    // the shallowest entry is the least valuable one, since it saved the least work.
+    // anything left over from an older search is worth less than that.
+    TransposSlot* victim = NULL;
+    u8  victim_staleness = 0;
+    u16 victim_depth = 0;
+
+    for_range(i, 0, TT_BUCKET_SIZE) {
+        TransposSlot* slot = &bucket->slots[i];
+        u64 slot_key  = atomic_load_explicit(&slot->key, memory_order_relaxed);
+        u64 slot_data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+
+        // same position. a deeper result from this search stays put, otherwise take it.
+        // a fail-low has no move of its own, so keep whatever move an earlier search found here.
+        if ((slot_key ^ slot_data) == zobrist) {
+            if (slot_age(slot_data) == tt->generation && slot_depth(slot_data) > depth) return;
+            if (is_move_null(move)) data |= (u64)slot_move(slot_data) << 24;
+            slot_store(slot, zobrist, data);
+            return;
+        }
+
+        // free slot
+        if (slot_key == 0 && slot_data == 0) {
+            slot_store(slot, zobrist, data);
+            return;
+        }
+
+        if (i == TT_BUCKET_SIZE - 1) break;
+
+        u8 staleness = tt->generation - slot_age(slot_data);
+        if (victim == NULL || staleness > victim_staleness ||
+            (staleness == victim_staleness && slot_depth(slot_data) < victim_depth)) {
+            victim = slot;
+            victim_staleness = staleness;
+            victim_depth = slot_depth(slot_data);
+        }
+    }
+
+    // stale entries always go first. otherwise only evict the shallowest
+    // depth-preferred entry if this one is at least as deep, and if not,
+    // put it in the always-replace slot so a recent result is still around
+    if (victim_staleness != 0 || depth >= victim_depth) {
+        slot_store(victim, zobrist, data);
+    } else {
+        slot_store(&bucket->slots[TT_BUCKET_SIZE - 1], zobrist, data);
+    }
+}
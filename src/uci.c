@@ -0,0 +1,282 @@
+#include "chess.h"
+#include <pthread.h>
+
+// uci front-end, so a player can be run headless under a match manager or gui.
+// the main thread only reads commands. searches run on one worker thread that lives
+// for the whole session, so a go doesnt wait on a thread being spun up, and stop,
+// ponderhit and isready still get answered mid-search.
+
+SearchLimits search_limits = {};
+atomic_bool search_stop = false;
+atomic_bool search_ponder = false;
+_Thread_local Move search_ponder_move = NULL_MOVE;
+
+size_t engine_hash_mb = 8;
+int    engine_threads = 1;
+bool   engine_log = true;
+char*  engine_nnue_file = "nets/v8.nnue";
+
+void (*search_report)(int depth, int eval, u64 nodes, Move best) = NULL;
+
+#define UCI_LINE_LEN 65536
+#define STARTPOS_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -"
+
+static const Player* uci_player;
+static void* uci_player_ctx;
+static Board uci_board;
+
+// everything below is guarded by worker_mutex
+static pthread_t worker;
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  worker_cond = PTHREAD_COND_INITIALIZER;
+static bool go_pending = false; // a go is waiting for the worker to pick it up
+static bool searching = false;  // from the go until its bestmove is out
+static bool worker_quit = false;
+static u64 search_start_milliseconds;
+
+static u64 milliseconds_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000 + (u64)ts.tv_nsec / 1000000;
+}
+
+static void uci_report(int depth, int eval, u64 nodes, Move best) {
+    u64 elapsed = milliseconds_now() - search_start_milliseconds;
+    char buf[8];
+
+    // mates go out as moves to the mate, negative if we are the ones getting mated
+    char score[32];
+    int plies_to_mate = MATE_SCORE - abs(eval);
+    if (plies_to_mate < MAX_MATE_PLIES) {
+        int moves_to_mate = (plies_to_mate + 1) / 2;
+        sprintf(score, "mate %d", eval > 0 ? moves_to_mate : -moves_to_mate);
+    } else {
+        sprintf(score, "cp %d", eval);
+    }
+
+    printf("info depth %d score %s nodes %llu time %llu nps %llu pv %s\n",
+        depth, score, nodes, elapsed, nodes * 1000 / max(elapsed, 1), move_string(best, buf));
+    fflush(stdout);
+}
+
+static void print_bestmove(Move best) {
+    char buf[8];
+    char ponder_buf[8];
+    if (is_move_null(best)) {
+        printf("bestmove 0000\n");
+    } else if (is_move_null(search_ponder_move)) {
+        printf("bestmove %s\n", move_string(best, buf));
+    } else {
+        printf("bestmove %s ponder %s\n", move_string(best, buf), move_string(search_ponder_move, ponder_buf));
+    }
+    fflush(stdout);
+}
+
+static void* search_worker(void* arg) {
+    pthread_mutex_lock(&worker_mutex);
+    while (true) {
+        while (!go_pending && !worker_quit) pthread_cond_wait(&worker_cond, &worker_mutex);
+        if (worker_quit) break;
+        go_pending = false;
+        pthread_mutex_unlock(&worker_mutex);
+
+        int eval = 0;
+        search_ponder_move = NULL_MOVE;
+        Move best = uci_player->select(uci_player_ctx, &uci_board, &eval);
+
+        pthread_mutex_lock(&worker_mutex);
+        // go infinite and go ponder only end with a stop, even if the player finished early.
+        // a ponderhit turns the ponder into a normal search, which has finished by now.
+        while ((search_limits.infinite || search_ponder) && !search_stop) {
+            pthread_cond_wait(&worker_cond, &worker_mutex);
+        }
+        print_bestmove(best);
+        searching = false;
+        pthread_cond_broadcast(&worker_cond);
+    }
+    pthread_mutex_unlock(&worker_mutex);
+    return NULL;
+}
+
+// ask for the best move so far and wait for it to be printed
+static void stop_search() {
+    pthread_mutex_lock(&worker_mutex);
+    if (searching) {
+        search_stop = true;
+        pthread_cond_broadcast(&worker_cond);
+        while (searching) pthread_cond_wait(&worker_cond, &worker_mutex);
+    }
+    pthread_mutex_unlock(&worker_mutex);
+}
+
+// the opponent played the expected move, the clock is ours from here
+static void ponderhit() {
+    pthread_mutex_lock(&worker_mutex);
+    search_ponder = false;
+    pthread_cond_broadcast(&worker_cond);
+    pthread_mutex_unlock(&worker_mutex);
+}
+
+// position [startpos | fen <fen>] [moves <move>...]
+static void uci_position(char* args) {
+    char* moves = strstr(args, "moves");
+    if (moves != NULL) moves[-1] = '\0';
+
+    if (strncmp(args, "startpos", 8) == 0) {
+        load_board(&uci_board, STARTPOS_FEN);
+    } else if (strncmp(args, "fen ", 4) == 0) {
+        load_board(&uci_board, args + 4);
+    } else {
+        return;
+    }
+
+    if (moves == NULL) return;
+    for (char* token = strtok(moves + 5, " \n"); token != NULL; token = strtok(NULL, " \n")) {
+        // the search needs room on the move stack too
+        if (uci_board.move_stack_len + SEARCH_PLY_RESERVE >= MAX_GAME_PLIES) {
+            printf("info string game too long, ignoring moves from %s\n", token);
+            break;
+        }
+        Move m = parse_move(&uci_board, token);
+        if (is_move_null(m)) {
+            printf("info string illegal move %s\n", token);
+            break;
+        }
+        make_move(&uci_board, m, true);
+    }
+}
+
+// go [ponder] [wtime N] [btime N] [winc N] [binc N] [movestogo N] [movetime N] [depth N] [nodes N] [infinite]
+static void uci_go(char* args) {
+    SearchLimits limits = {};
+    bool ponder = false;
+    bool limited = false;
+
+    for (char* token = strtok(args, " \n"); token != NULL; token = strtok(NULL, " \n")) {
+        if (strcmp(token, "infinite") == 0) {
+            limits.infinite = true;
+            continue;
+        }
+        if (strcmp(token, "ponder") == 0) {
+            ponder = true;
+            continue;
+        }
+
+        char* value = strtok(NULL, " \n");
+        if (value == NULL) break;
+        u64 n = strtoull(value, NULL, 10);
+
+        if      (strcmp(token, "wtime") == 0)     limits.time[WHITE >> 3] = n;
+        else if (strcmp(token, "btime") == 0)     limits.time[BLACK >> 3] = n;
+        else if (strcmp(token, "winc") == 0)      limits.increment[WHITE >> 3] = n;
+        else if (strcmp(token, "binc") == 0)      limits.increment[BLACK >> 3] = n;
+        else if (strcmp(token, "movestogo") == 0) limits.moves_to_go = n;
+        else if (strcmp(token, "movetime") == 0)  limits.movetime = n;
+        else if (strcmp(token, "depth") == 0)     limits.depth = n;
+        else if (strcmp(token, "nodes") == 0)     limits.nodes = n;
+        else continue;
+        limited = true;
+    }
+
+    // a bare go searches until told to stop. any limit at all, even just the
+    // other side's clock, keeps the player on its own time management.
+    if (!limited) limits.infinite = true;
+
+    pthread_mutex_lock(&worker_mutex);
+    search_limits = limits;
+    search_stop = false;
+    search_ponder = ponder;
+    search_start_milliseconds = milliseconds_now();
+    go_pending = true;
+    searching = true;
+    pthread_cond_broadcast(&worker_cond);
+    pthread_mutex_unlock(&worker_mutex);
+}
+
+// setoption name <name> value <value>
+static void uci_setoption(char* args) {
+    char* name = strstr(args, "name ");
+    char* value = strstr(args, "value ");
+    if (name == NULL || value == NULL) return;
+    name += 5;
+    value += 6;
+
+    if (strncmp(name, "Hash", 4) == 0) {
+        engine_hash_mb = max(atoi(value), 1);
+    } else if (strncmp(name, "Threads", 7) == 0) {
+        engine_threads = max(atoi(value), 1);
+    } else if (strncmp(name, "EvalFile", 8) == 0) {
+        // no search is running, so nothing is reading the network while it changes
+        if (!nnue_load(value)) printf("info string cant load network %s\n", value);
+    }
+}
+
+// chess uci [player]
+int uci_main(int argc, char** argv) {
+    uci_player = &player_v8;
+    if (argc >= 1) {
+        uci_player = find_player(argv[0]);
+        if (uci_player == NULL) {
+            printf("no player named '%s'\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // stdout belongs to the protocol now
+    engine_log = false;
+    search_report = uci_report;
+
+    uci_player_ctx = uci_player->init();
+    init_board(&uci_board);
+    pthread_create(&worker, NULL, search_worker, NULL);
+
+    char* line = malloc(UCI_LINE_LEN);
+    while (fgets(line, UCI_LINE_LEN, stdin) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (strcmp(line, "uci") == 0) {
+            printf("id name chess %s\n", uci_player->name);
+            printf("id author spsandwichman\n");
+            printf("option name Hash type spin default %zu min 1 max 65536\n", engine_hash_mb);
+            printf("option name Threads type spin default %d min 1 max 256\n", engine_threads);
+            printf("option name Ponder type check default false\n");
+            printf("option name EvalFile type string default %s\n", engine_nnue_file);
+            printf("uciok\n");
+        } else if (strcmp(line, "isready") == 0) {
+            printf("readyok\n");
+        } else if (strncmp(line, "setoption ", 10) == 0) {
+            stop_search();
+            uci_setoption(line + 10);
+        } else if (strcmp(line, "ucinewgame") == 0) {
+            stop_search();
+            // a fresh instance, so nothing from the last game leaks into this one
+            uci_player->destroy(uci_player_ctx);
+            uci_player_ctx = uci_player->init();
+        } else if (strncmp(line, "position ", 9) == 0) {
+            stop_search();
+            uci_position(line + 9);
+        } else if (strncmp(line, "go", 2) == 0 && (line[2] == ' ' || line[2] == '\0')) {
+            stop_search();
+            uci_go(line + 2);
+        } else if (strcmp(line, "stop") == 0) {
+            stop_search();
+        } else if (strcmp(line, "ponderhit") == 0) {
+            ponderhit();
+        } else if (strcmp(line, "quit") == 0) {
+            break;
+        }
+        fflush(stdout);
+    }
+
+    stop_search();
+    pthread_mutex_lock(&worker_mutex);
+    worker_quit = true;
+    pthread_cond_broadcast(&worker_cond);
+    pthread_mutex_unlock(&worker_mutex);
+    pthread_join(worker, NULL);
+
+    free(line);
+    uci_player->destroy(uci_player_ctx);
+    destroy_board(&uci_board);
+    return EXIT_SUCCESS;
+}